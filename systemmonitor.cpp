@@ -1,7 +1,7 @@
 // system_monitor.cpp
 // Single-file system monitor (top-like) for Linux (WSL/Ubuntu).
-// Compile: g++ -std=c++17 -O2 system_monitor.cpp -lncurses -o system_monitor
-// Run:   ./system_monitor    (run inside WSL/Ubuntu)
+// Compile: g++ -std=c++17 -O2 -pthread system_monitor.cpp -lncurses -o system_monitor
+// Run:   ./system_monitor [-t threads]    (run inside WSL/Ubuntu)
 
 #include <ncurses.h>
 #include <dirent.h>
@@ -10,159 +10,3515 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <netinet/in.h>
+#include <ftw.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <time.h>
 
 #include <string>
 #include <vector>
-#include <map>
+#include <deque>
+#include <set>
+#include <array>
+#include <string_view>
+#include <cstdint>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <iomanip>
 #include <iostream>
+#include <random>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
 
 using namespace std::chrono;
 
-struct Proc {
-    int pid = 0;
-    std::string name;
-    unsigned long long prev_time = 0; // in clock ticks
-    unsigned long long time = 0;      // current time in clock ticks
-    long rss_pages = 0;               // resident set size (pages)
+// Interned process names. Each distinct comm is stored once; rows refer to
+// it by index. The deque keeps strings in place, so the index can key on
+// string_views into it.
+struct NamePool {
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, uint32_t> index;
+
+    uint32_t intern(const char *s) {
+        auto it = index.find(std::string_view(s));
+        if (it != index.end()) return it->second;
+        uint32_t id = (uint32_t)names.size();
+        names.emplace_back(s);
+        index.emplace(std::string_view(names.back()), id);
+        return id;
+    }
+
+    void clear() {
+        index.clear();
+        names.clear();
+    }
+
+    size_t size() const { return names.size(); }
+    const std::string &operator[](uint32_t id) const { return names[id]; }
+};
+
+// Cumulative I/O counters from /proc/<pid>/io.
+struct IoCounters {
+    unsigned long long read_bytes = 0;  // fetched from storage
+    unsigned long long write_bytes = 0; // sent (or to be sent) to storage
+    unsigned long long syscr = 0;       // read syscalls
+    unsigned long long syscw = 0;       // write syscalls
+};
+
+// Per-second rates of the same counters.
+struct IoRates {
+    double read_bps = 0.0;
+    double write_bps = 0.0;
+    double syscr = 0.0;
+    double syscw = 0.0;
+};
+
+// Delay accounting and memory high-water marks of one process, from the
+// taskstats backend; zero without --taskstats.
+struct TaskAcct {
+    unsigned long long cpu_delay_ns = 0;    // runnable but waiting for a CPU
+    unsigned long long blkio_delay_ns = 0;  // waiting for block I/O
+    unsigned long long swapin_delay_ns = 0; // waiting for swap-in
+    unsigned long long hiwater_rss_kb = 0;  // peak resident set size
+    unsigned long long hiwater_vm_kb = 0;   // peak virtual memory size
+};
+
+// TCP and UDP sockets behind one process's descriptors.
+struct SockSummary {
+    uint32_t tcp = 0;
+    uint32_t udp = 0;
+    uint64_t rx_queue = 0; // bytes received but not yet read (accept backlog for listeners)
+    uint64_t tx_queue = 0; // bytes not yet sent or acknowledged
+    bool ok = false;       // /proc/<pid>/fd could be listed
+};
+
+// Memory of one process by sharing, from /proc/<pid>/smaps_rollup, in kB.
+struct MemDetail {
+    unsigned long long pss_kb = 0;    // proportional set size: shared pages split among their users
+    unsigned long long uss_kb = 0;    // unique set size: private pages only
+    unsigned long long shared_kb = 0; // resident pages also mapped by other processes
+    unsigned long long swap_kb = 0;
+    bool ok = false;                  // measured (not a kernel thread, readable)
+};
+
+// Process table stored column-wise, one entry per row in each vector, so the
+// per-tick delta/percentage loop and the sorts only stream the columns they
+// use. The table is refilled in place every tick to reuse its capacity.
+struct ProcTable {
+    std::vector<int> pid;
+    std::vector<int> ppid;
+    std::vector<unsigned long long> time;      // current CPU time, in 1/time_hz s
+    std::vector<unsigned long long> prev_time; // previous sample, same unit
+    std::vector<long> rss_pages;               // resident set size (pages)
+    std::vector<double> cpu_pct;
+    std::vector<double> mem_pct;
+    std::vector<uint32_t> name_id;             // index into names
+    std::vector<std::array<char, 64>> comm;    // raw comm from the scan, interned afterwards
+    std::vector<uint8_t> stale;                // 1 = not re-read this tick (adaptive sampling)
+    std::vector<uint32_t> cgroup_id;           // index into cgroups; only filled for the cgroup view
+    std::vector<IoCounters> io;                // current sample
+    std::vector<IoRates> io_rate;
+    std::vector<uint8_t> io_ok;                // 0 = /proc/<pid>/io not readable (other user, threads)
+    std::vector<SockSummary> socks;            // only filled for the socket view
+    std::vector<MemDetail> smaps;              // only filled for the memory view
+    std::vector<TaskAcct> acct;                // only filled by the taskstats backend
+    NamePool names;
+    NamePool cgroups; // cgroup v2 paths, relative to cgroup_root
+    double time_hz = 0.0; // units of `time` per second: CLK_TCK, or 1e9 from taskstats
+
+    size_t size() const { return pid.size(); }
+
+    void resize(size_t n) {
+        pid.resize(n);
+        ppid.resize(n);
+        time.resize(n);
+        prev_time.resize(n);
+        rss_pages.resize(n);
+        cpu_pct.resize(n);
+        mem_pct.resize(n);
+        name_id.resize(n);
+        comm.resize(n);
+        stale.resize(n);
+        cgroup_id.resize(n);
+        io.resize(n);
+        io_rate.resize(n);
+        io_ok.resize(n);
+        socks.resize(n);
+        smaps.resize(n);
+        acct.resize(n);
+    }
+};
+
+static long CLK_TCK = sysconf(_SC_CLK_TCK);
+static long PAGE_SIZE = sysconf(_SC_PAGESIZE);
+
+// Root of the proc filesystem; every reader goes through it so the monitor
+// can be pointed at a synthetic tree (--proc-root, --bench).
+static std::string proc_root = "/proc";
+
+std::string proc_path(const char *rel) {
+    return proc_root + "/" + rel;
+}
+
+// Mount point of the cgroup v2 hierarchy (--cgroup-root).
+static std::string cgroup_root = "/sys/fs/cgroup";
+
+// Log-linear latency histogram in the spirit of HdrHistogram: every power of
+// two is split into 16 linear sub-buckets (relative error <= 1/16). record()
+// is a handful of relaxed atomic operations, so scan workers and the UI
+// thread can record into the same histogram without locks.
+struct LatencyHistogram {
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+
+    static int index(uint64_t v) {
+        if (v < (uint64_t)SUB) return (int)v;
+        int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+        return (shift + 1) * SUB + (int)((v >> shift) & (SUB - 1));
+    }
+
+    // smallest value that lands in bucket i
+    static uint64_t lower_bound(int i) {
+        if (i < SUB) return (uint64_t)i;
+        int shift = i / SUB - 1;
+        return (uint64_t)(SUB + i % SUB) << shift;
+    }
+
+    void record(uint64_t v) {
+        counts[index(v)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(v, std::memory_order_relaxed);
+        uint64_t m = max.load(std::memory_order_relaxed);
+        while (v > m && !max.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+    }
+
+    // value at quantile q (0..1), reported as the middle of its bucket
+    uint64_t percentile(double q) const {
+        uint64_t n = total.load(std::memory_order_relaxed);
+        if (n == 0) return 0;
+        uint64_t rank = (uint64_t)(q * (double)(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t lo = lower_bound(i);
+                uint64_t hi = i + 1 < BUCKETS ? lower_bound(i + 1) : lo;
+                return std::min(lo + (hi - lo) / 2, max.load(std::memory_order_relaxed));
+            }
+        }
+        return max.load(std::memory_order_relaxed);
+    }
+};
+
+// Phases of one refresh tick, timed into phase_hist. Collection phases,
+// "late" (wakeup past the tick deadline) and "tick" are recorded by the
+// collector thread, sort/render/"sleep" (waiting for input) by the UI thread.
+enum Phase { PH_SCAN, PH_PARSE, PH_THREADS, PH_SYSTEM, PH_DELTA, PH_SORT, PH_RENDER, PH_SLEEP, PH_LATE, PH_TICK, PH_COUNT };
+static const char *PHASE_NAMES[PH_COUNT] = {"scan",   "parse", "threads", "system", "delta",
+                                            "sort",   "render", "sleep",  "late",   "tick"};
+static LatencyHistogram phase_hist[PH_COUNT];
+static std::atomic<uint64_t> ticks_skipped{0}; // deadlines missed by an overrunning tick
+
+// Record the time since `start` into phase_hist[ph] (nanoseconds) and
+// return the current time, so consecutive phases can be chained.
+steady_clock::time_point record_phase(Phase ph, steady_clock::time_point start) {
+    auto now = steady_clock::now();
+    phase_hist[ph].record((uint64_t)duration_cast<nanoseconds>(now - start).count());
+    return now;
+}
+
+// Times the enclosing scope into phase_hist[phase].
+struct PhaseTimer {
+    Phase phase;
+    steady_clock::time_point start = steady_clock::now();
+    explicit PhaseTimer(Phase p) : phase(p) {}
+    ~PhaseTimer() { record_phase(phase, start); }
+};
+
+// One summary line per phase, values in milliseconds. Line 0 is the header.
+void format_phase_line(int ph, char *buf, size_t cap) {
+    if (ph < 0) {
+        snprintf(buf, cap, "%-7s %9s %9s %9s %9s %9s %9s", "phase", "count", "mean ms", "p50", "p90", "p99", "max");
+        return;
+    }
+    const LatencyHistogram &h = phase_hist[ph];
+    uint64_t n = h.total.load(std::memory_order_relaxed);
+    double mean = n ? (double)h.sum.load(std::memory_order_relaxed) / (double)n : 0.0;
+    snprintf(buf, cap, "%-7s %9llu %9.3f %9.3f %9.3f %9.3f %9.3f", PHASE_NAMES[ph], (unsigned long long)n,
+             mean / 1e6, h.percentile(0.50) / 1e6, h.percentile(0.90) / 1e6, h.percentile(0.99) / 1e6,
+             h.max.load(std::memory_order_relaxed) / 1e6);
+}
+
+void dump_phase_stats(FILE *out) {
+    char buf[160];
+    format_phase_line(-1, buf, sizeof(buf));
+    fprintf(out, "%s\n", buf);
+    for (int ph = 0; ph < PH_COUNT; ++ph) {
+        if (phase_hist[ph].total.load(std::memory_order_relaxed) == 0) continue;
+        format_phase_line(ph, buf, sizeof(buf));
+        fprintf(out, "%s\n", buf);
+    }
+    uint64_t skipped = ticks_skipped.load(std::memory_order_relaxed);
+    if (skipped) fprintf(out, "skipped ticks: %llu\n", (unsigned long long)skipped);
+}
+
+double get_uptime_seconds() {
+    std::ifstream f(proc_path("uptime"));
+    double up = 0;
+    f >> up;
+    return up;
+}
+
+bool is_digits(const char* s) {
+    if (!s || !*s) return false;
+    while (*s) {
+        if (!isdigit(*s)) return false;
+        ++s;
+    }
+    return true;
+}
+
+// Typed view of /proc/<pid>/stat. Field numbers in comments follow proc(5);
+// fields the running kernel does not report are left zero.
+struct StatRecord {
+    int pid = 0;                          // (1)
+    char comm[64] = {0};                  // (2) without the parentheses
+    char state = '?';                     // (3)
+    int ppid = 0;                         // (4)
+    int pgrp = 0;                         // (5)
+    int session = 0;                      // (6)
+    int tty_nr = 0;                       // (7)
+    int tpgid = 0;                        // (8)
+    unsigned int flags = 0;               // (9)
+    unsigned long minflt = 0;             // (10)
+    unsigned long cminflt = 0;            // (11)
+    unsigned long majflt = 0;             // (12)
+    unsigned long cmajflt = 0;            // (13)
+    unsigned long utime = 0;              // (14) clock ticks
+    unsigned long stime = 0;              // (15) clock ticks
+    long cutime = 0;                      // (16)
+    long cstime = 0;                      // (17)
+    long priority = 0;                    // (18)
+    long nice = 0;                        // (19)
+    long num_threads = 0;                 // (20)
+    long itrealvalue = 0;                 // (21)
+    unsigned long long starttime = 0;     // (22) clock ticks since boot
+    unsigned long vsize = 0;              // (23) bytes
+    long rss = 0;                         // (24) pages
+    unsigned long rsslim = 0;             // (25)
+    unsigned long startcode = 0;          // (26)
+    unsigned long endcode = 0;            // (27)
+    unsigned long startstack = 0;         // (28)
+    unsigned long kstkesp = 0;            // (29)
+    unsigned long kstkeip = 0;            // (30)
+    unsigned long signal = 0;             // (31)
+    unsigned long blocked = 0;            // (32)
+    unsigned long sigignore = 0;          // (33)
+    unsigned long sigcatch = 0;           // (34)
+    unsigned long wchan = 0;              // (35)
+    unsigned long nswap = 0;              // (36)
+    unsigned long cnswap = 0;             // (37)
+    int exit_signal = 0;                  // (38)
+    int processor = 0;                    // (39)
+    unsigned int rt_priority = 0;         // (40)
+    unsigned int policy = 0;              // (41)
+    unsigned long long delayacct_blkio_ticks = 0; // (42)
+    unsigned long guest_time = 0;         // (43)
+    long cguest_time = 0;                 // (44)
+    unsigned long start_data = 0;         // (45)
+    unsigned long end_data = 0;           // (46)
+    unsigned long start_brk = 0;          // (47)
+    unsigned long arg_start = 0;          // (48)
+    unsigned long arg_end = 0;            // (49)
+    unsigned long env_start = 0;          // (50)
+    unsigned long env_end = 0;            // (51)
+    int exit_code = 0;                    // (52)
+};
+
+// Hand-rolled decimal decoder for procfs text. Skips leading blanks, accepts
+// an optional '-' (stored two's complement so signed fields cast back cleanly)
+// and advances p past the digits. Returns false if no number was found.
+static inline bool next_num(const char *&p, const char *end, unsigned long long &out) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    bool neg = false;
+    if (p < end && *p == '-') { neg = true; ++p; }
+    if (p >= end || (unsigned)(*p - '0') > 9) return false;
+    unsigned long long v = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9) {
+        v = v * 10 + (unsigned)(*p - '0');
+        ++p;
+    }
+    out = neg ? (0ULL - v) : v;
+    return true;
+}
+
+// Read a small procfs file into a caller-provided buffer without touching the
+// heap. Returns the number of bytes read (NUL-terminated), or -1 on failure.
+ssize_t read_small_file(const char *path, char *buf, size_t cap) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, cap - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+// /proc/meminfo fields kept by MemInfo, in the kernel's order. Values are in
+// kB except the HugePages_* counts. Keys missing on this kernel read as 0.
+enum MemField {
+    MI_MemTotal, MI_MemFree, MI_MemAvailable, MI_Buffers, MI_Cached, MI_SwapCached,
+    MI_Active, MI_Inactive, MI_ActiveAnon, MI_InactiveAnon, MI_ActiveFile, MI_InactiveFile,
+    MI_Unevictable, MI_Mlocked, MI_SwapTotal, MI_SwapFree, MI_Zswap, MI_Zswapped,
+    MI_Dirty, MI_Writeback, MI_AnonPages, MI_Mapped, MI_Shmem, MI_KReclaimable,
+    MI_Slab, MI_SReclaimable, MI_SUnreclaim, MI_KernelStack, MI_ShadowCallStack, MI_PageTables,
+    MI_SecPageTables, MI_NFS_Unstable, MI_Bounce, MI_WritebackTmp, MI_CommitLimit, MI_Committed_AS,
+    MI_VmallocTotal, MI_VmallocUsed, MI_VmallocChunk, MI_Percpu, MI_HardwareCorrupted, MI_AnonHugePages,
+    MI_ShmemHugePages, MI_ShmemPmdMapped, MI_FileHugePages, MI_FilePmdMapped, MI_CmaTotal, MI_CmaFree,
+    MI_Unaccepted, MI_Balloon, MI_HugePages_Total, MI_HugePages_Free, MI_HugePages_Rsvd, MI_HugePages_Surp, MI_Hugepagesize,
+    MI_Hugetlb, MI_DirectMap4k, MI_DirectMap2M, MI_DirectMap1G, MI_COUNT
+};
+static constexpr const char *MEMINFO_KEYS[] = {
+    "MemTotal", "MemFree", "MemAvailable", "Buffers", "Cached", "SwapCached",
+    "Active", "Inactive", "Active(anon)", "Inactive(anon)", "Active(file)", "Inactive(file)",
+    "Unevictable", "Mlocked", "SwapTotal", "SwapFree", "Zswap", "Zswapped",
+    "Dirty", "Writeback", "AnonPages", "Mapped", "Shmem", "KReclaimable",
+    "Slab", "SReclaimable", "SUnreclaim", "KernelStack", "ShadowCallStack", "PageTables",
+    "SecPageTables", "NFS_Unstable", "Bounce", "WritebackTmp", "CommitLimit", "Committed_AS",
+    "VmallocTotal", "VmallocUsed", "VmallocChunk", "Percpu", "HardwareCorrupted", "AnonHugePages",
+    "ShmemHugePages", "ShmemPmdMapped", "FileHugePages", "FilePmdMapped", "CmaTotal", "CmaFree",
+    "Unaccepted", "Balloon", "HugePages_Total", "HugePages_Free", "HugePages_Rsvd", "HugePages_Surp", "Hugepagesize",
+    "Hugetlb", "DirectMap4k", "DirectMap2M", "DirectMap1G"};
+static_assert(sizeof(MEMINFO_KEYS) / sizeof(MEMINFO_KEYS[0]) == MI_COUNT, "MEMINFO_KEYS out of sync with MemField");
+
+// Perfect hash from key to MemField: seeded FNV-1a into 512 slots, with the
+// seed searched at compile time until no two known keys share a slot. A
+// lookup is one hash plus one key compare (unknown keys land on an empty or
+// foreign slot and fail the compare).
+static constexpr uint32_t MEMINFO_SLOTS = 512;
+
+constexpr uint32_t meminfo_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; ++i) h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return (h ^ (h >> 16)) & (MEMINFO_SLOTS - 1);
+}
+
+constexpr size_t const_strlen(const char *s) {
+    size_t n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+struct MemInfoIndex {
+    uint32_t seed = 0;
+    std::array<uint8_t, MEMINFO_SLOTS> slot{}; // MemField, or 0xff if empty
+};
+
+constexpr MemInfoIndex build_meminfo_index() {
+    for (uint32_t seed = 0;; ++seed) {
+        MemInfoIndex idx;
+        idx.seed = seed;
+        for (uint32_t i = 0; i < MEMINFO_SLOTS; ++i) idx.slot[i] = 0xff;
+        bool ok = true;
+        for (int k = 0; k < MI_COUNT && ok; ++k) {
+            uint32_t h = meminfo_hash(MEMINFO_KEYS[k], const_strlen(MEMINFO_KEYS[k]), seed);
+            if (idx.slot[h] != 0xff) ok = false;
+            else idx.slot[h] = (uint8_t)k;
+        }
+        if (ok) return idx;
+    }
+}
+
+static constexpr MemInfoIndex MEMINFO_INDEX = build_meminfo_index();
+
+struct MemInfo {
+    std::array<unsigned long long, MI_COUNT> v{};
+
+    unsigned long long operator[](MemField f) const { return v[f]; }
+    double mb(MemField f) const { return v[f] / 1024.0; }
+};
+
+// Parse all of /proc/meminfo in one pass over a stack buffer, through a
+// descriptor kept open between samples.
+struct MemInfoReader {
+    int fd = -1;
+
+    MemInfoReader() { fd = open(proc_path("meminfo").c_str(), O_RDONLY | O_CLOEXEC); }
+
+    ~MemInfoReader() {
+        if (fd >= 0) close(fd);
+    }
+
+    MemInfoReader(const MemInfoReader &) = delete;
+    MemInfoReader &operator=(const MemInfoReader &) = delete;
+
+    bool read(MemInfo &out) {
+        out = MemInfo{};
+        char buf[8192];
+        ssize_t n = fd >= 0 ? pread(fd, buf, sizeof(buf) - 1, 0) : -1;
+        if (n <= 0) return false;
+        const char *end = buf + n;
+        for (const char *line = buf; line < end;) {
+            const char *eol = (const char *)memchr(line, '\n', end - line);
+            if (!eol) eol = end;
+            const char *colon = (const char *)memchr(line, ':', eol - line);
+            if (colon) {
+                size_t len = (size_t)(colon - line);
+                uint8_t k = MEMINFO_INDEX.slot[meminfo_hash(line, len, MEMINFO_INDEX.seed)];
+                const char *p = colon + 1;
+                if (k != 0xff && strlen(MEMINFO_KEYS[k]) == len && memcmp(MEMINFO_KEYS[k], line, len) == 0) {
+                    next_num(p, eol, out.v[k]);
+                }
+            }
+            line = eol + 1;
+        }
+        return true;
+    }
+};
+
+// Parse one /proc/<pid>/stat line. comm may itself contain spaces and ')',
+// so it is taken as everything between the first '(' and the last ')'.
+bool parse_stat_line(const char *buf, size_t len, StatRecord &r) {
+    r = StatRecord{};
+    const char *p = buf;
+    const char *end = buf + len;
+    unsigned long long pid = 0;
+    if (!next_num(p, end, pid)) return false;
+    r.pid = (int)pid;
+
+    const char *lp = (const char *)memchr(p, '(', end - p);
+    const char *rp = (const char *)memrchr(p, ')', end - p);
+    if (!lp || !rp || rp < lp) return false;
+    size_t comm_len = std::min((size_t)(rp - lp - 1), sizeof(r.comm) - 1);
+    memcpy(r.comm, lp + 1, comm_len);
+    r.comm[comm_len] = '\0';
+
+    p = rp + 1;
+    while (p < end && *p == ' ') ++p;
+    if (p >= end) return false;
+    r.state = *p++;
+
+    // fields (4) .. (52)
+    unsigned long long f[49];
+    size_t n = 0;
+    while (n < 49 && next_num(p, end, f[n])) ++n;
+    if (n < 19) return false; // need at least up to starttime (22)
+    for (size_t i = n; i < 49; ++i) f[i] = 0;
+
+    r.ppid = (int)f[0];
+    r.pgrp = (int)f[1];
+    r.session = (int)f[2];
+    r.tty_nr = (int)f[3];
+    r.tpgid = (int)f[4];
+    r.flags = (unsigned int)f[5];
+    r.minflt = (unsigned long)f[6];
+    r.cminflt = (unsigned long)f[7];
+    r.majflt = (unsigned long)f[8];
+    r.cmajflt = (unsigned long)f[9];
+    r.utime = (unsigned long)f[10];
+    r.stime = (unsigned long)f[11];
+    r.cutime = (long)f[12];
+    r.cstime = (long)f[13];
+    r.priority = (long)f[14];
+    r.nice = (long)f[15];
+    r.num_threads = (long)f[16];
+    r.itrealvalue = (long)f[17];
+    r.starttime = f[18];
+    r.vsize = (unsigned long)f[19];
+    r.rss = (long)f[20];
+    r.rsslim = (unsigned long)f[21];
+    r.startcode = (unsigned long)f[22];
+    r.endcode = (unsigned long)f[23];
+    r.startstack = (unsigned long)f[24];
+    r.kstkesp = (unsigned long)f[25];
+    r.kstkeip = (unsigned long)f[26];
+    r.signal = (unsigned long)f[27];
+    r.blocked = (unsigned long)f[28];
+    r.sigignore = (unsigned long)f[29];
+    r.sigcatch = (unsigned long)f[30];
+    r.wchan = (unsigned long)f[31];
+    r.nswap = (unsigned long)f[32];
+    r.cnswap = (unsigned long)f[33];
+    r.exit_signal = (int)f[34];
+    r.processor = (int)f[35];
+    r.rt_priority = (unsigned int)f[36];
+    r.policy = (unsigned int)f[37];
+    r.delayacct_blkio_ticks = f[38];
+    r.guest_time = (unsigned long)f[39];
+    r.cguest_time = (long)f[40];
+    r.start_data = (unsigned long)f[41];
+    r.end_data = (unsigned long)f[42];
+    r.start_brk = (unsigned long)f[43];
+    r.arg_start = (unsigned long)f[44];
+    r.arg_end = (unsigned long)f[45];
+    r.env_start = (unsigned long)f[46];
+    r.env_end = (unsigned long)f[47];
+    r.exit_code = (int)f[48];
+    return true;
+}
+
+// Per-PID cache of open /proc/<pid>/{stat,statm} descriptors. Long-lived
+// processes are re-read with pread(fd, buf, n, 0) each tick instead of paying
+// open/read/close for every file. A read on a descriptor whose process has
+// exited fails with ESRCH; the entry is then dropped (and reopened once in
+// case the PID was recycled). Entries for PIDs missing from a scan are
+// evicted in end_scan().
+struct PidHandles {
+    int stat_fd = -1;
+    int statm_fd = -1;
+    int io_fd = -1;
+    unsigned gen = 0; // scan generation that last saw this PID
+
+    // adaptive sampling: the values last read, carried over on ticks the
+    // PID is skipped, and the scan tick at which it is due again
+    bool sampled = false;
+    uint8_t idle_level = 0; // reads are 1 << idle_level ticks apart
+    uint64_t due = 0;
+    int ppid = 0;
+    unsigned long long time = 0;
+    long rss_pages = 0;
+    std::array<char, 64> comm{};
+    IoCounters io;
+    bool io_ok = false;
+    TaskAcct acct;
+
+    // /proc/<pid>/io is only readable for our own processes (or with
+    // CAP_SYS_PTRACE); a refusal is remembered for the process instance with
+    // this start time rather than retried every tick
+    unsigned long long io_denied_start = ~0ULL;
+
+    // socket view: descriptor -> socket inode (0 = not a socket) from the
+    // last walk of /proc/<pid>/fd, sorted by descriptor, and when to walk
+    // again; a refused walk is remembered like for io
+    std::vector<std::pair<int, uint64_t>> fds;
+    uint64_t fds_due = 0;
+    unsigned fd_walks = 0;
+    unsigned long long fd_denied_start = ~0ULL;
+
+    // memory view: the last smaps_rollup read (at steady-clock second
+    // smaps_time) of the process instance started at smaps_start, and a
+    // remembered refusal as above
+    MemDetail smaps;
+    double smaps_time = 0.0;
+    unsigned long long smaps_start = ~0ULL;
+    unsigned long long smaps_denied_start = ~0ULL;
+
+    // cgroup v2 path from /proc/<pid>/cgroup, valid while start_time matches
+    // cgroup_start (a recycled PID gets a new start time)
+    unsigned long long start_time = 0;
+    unsigned long long cgroup_start = ~0ULL;
+    std::string cgroup;
+};
+
+struct PidHandleCache {
+    std::unordered_map<int, PidHandles> entries;
+    unsigned gen = 0;
+    // descriptor budget, derived from RLIMIT_NOFILE and shared by all
+    // caches and scan workers
+    static inline std::atomic<long> open_fds{0};
+    static inline long max_fds = 0;
+
+    PidHandleCache() {
+        // raise the soft fd limit to the hard limit and keep some headroom
+        // for ncurses, /proc/stat, /proc/meminfo and friends
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+            if (rl.rlim_cur < rl.rlim_max) {
+                rl.rlim_cur = rl.rlim_max;
+                setrlimit(RLIMIT_NOFILE, &rl);
+                getrlimit(RLIMIT_NOFILE, &rl);
+            }
+            rlim_t cur = rl.rlim_cur == RLIM_INFINITY ? (rlim_t)1 << 20 : rl.rlim_cur;
+            max_fds = cur > 64 ? (long)(cur - 64) : 0;
+        }
+    }
+
+    ~PidHandleCache() {
+        for (auto &kv : entries) close_handles(kv.second);
+    }
+
+    void begin_scan() { ++gen; }
+
+    // touch() and end_scan() modify the map and must run on the scanning
+    // thread; read() only touches its own entry and may run on any worker.
+    PidHandles &touch(int pid) {
+        PidHandles &h = entries[pid];
+        h.gen = gen;
+        return h;
+    }
+
+    void end_scan() {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second.gen != gen) {
+                close_handles(it->second);
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void close_fd(int &fd) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+            --open_fds;
+        }
+    }
+
+    void close_handles(PidHandles &h) {
+        close_fd(h.stat_fd);
+        close_fd(h.statm_fd);
+        close_fd(h.io_fd);
+    }
+
+    // Read /proc/<pid>/<leaf> through the cached descriptor in slot fd.
+    // Returns bytes read (NUL-terminated) or -1 if the process is gone.
+    ssize_t read(int pid, PidHandles &h, int &fd, const char *leaf, char *buf, size_t cap) {
+        char path[256];
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (fd < 0) {
+                snprintf(path, sizeof(path), "%s/%d/%s", proc_root.c_str(), pid, leaf);
+                if (open_fds >= max_fds) return read_small_file(path, buf, cap);
+                fd = open(path, O_RDONLY | O_CLOEXEC);
+                if (fd < 0) return -1;
+                ++open_fds;
+            }
+            ssize_t n = pread(fd, buf, cap - 1, 0);
+            if (n > 0) {
+                buf[n] = '\0';
+                return n;
+            }
+            // ESRCH (or an empty read): the task behind this descriptor exited.
+            // Drop all handles; a recycled PID gets a fresh open on retry.
+            close_handles(h);
+        }
+        return -1;
+    }
+};
+
+static PidHandleCache pid_handles;
+static PidHandleCache thread_handles; // keyed by TID, for the thread view
+
+// Read one thread of tgid from /proc/<tgid>/task/<tid>/stat, same fast path
+// as read_process_basic(). Threads share the process's memory, so RSS is
+// left at zero.
+bool read_thread_basic(int tgid, int tid, PidHandles &h, ProcTable &t, size_t row) {
+    t.pid[row] = tid;
+    t.ppid[row] = tgid;
+    t.time[row] = 0;
+    t.rss_pages[row] = 0;
+    t.comm[row][0] = '\0';
+    t.stale[row] = 0;
+    t.io[row] = IoCounters{};
+    t.io_ok[row] = 0;
+    char leaf[32];
+    snprintf(leaf, sizeof(leaf), "task/%d/stat", tid);
+    char buf[1024];
+    ssize_t n = thread_handles.read(tgid, h, h.stat_fd, leaf, buf, sizeof(buf));
+    StatRecord sr;
+    if (n <= 0 || !parse_stat_line(buf, (size_t)n, sr)) return false;
+    memcpy(t.comm[row].data(), sr.comm, sizeof(sr.comm));
+    t.time[row] = (unsigned long long)sr.utime + sr.stime;
+    return true;
+}
+
+// Resident set size in pages, from statm (size resident ...) or status.
+long read_rss_pages(int pid, PidHandles &h) {
+    char buf[1024];
+    ssize_t n = pid_handles.read(pid, h, h.statm_fd, "statm", buf, sizeof(buf));
+    if (n > 0) {
+        const char *c = buf;
+        const char *end = buf + n;
+        unsigned long long size = 0, rss = 0;
+        if (next_num(c, end, size) && next_num(c, end, rss)) return (long)rss; // pages
+        return 0;
+    }
+    // fallback: parse VmRSS in /proc/<pid>/status
+    std::ifstream st(proc_root + "/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(st, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            std::istringstream iss(line);
+            std::string k;
+            long kb;
+            iss >> k >> kb;
+            return kb * 1024 / PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
+// I/O counters from /proc/<pid>/io into `row`. Needs h.start_time from this
+// tick's stat read to tell a refused process from a recycled PID.
+void read_process_io(int pid, PidHandles &h, ProcTable &t, size_t row) {
+    t.io[row] = IoCounters{};
+    t.io_ok[row] = 0;
+    if (h.io_denied_start == h.start_time) return;
+    char buf[512];
+    ssize_t n = pid_handles.read(pid, h, h.io_fd, "io", buf, sizeof(buf));
+    if (n <= 0) {
+        // EACCES/EPERM for other users' processes, ENOENT without
+        // CONFIG_TASK_IO_ACCOUNTING; neither changes for this process
+        if (errno == EACCES || errno == EPERM || errno == ENOENT) h.io_denied_start = h.start_time;
+        return;
+    }
+    IoCounters &io = t.io[row];
+    const char *end = buf + n;
+    for (const char *line = buf; line < end;) {
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        const char *colon = (const char *)memchr(line, ':', eol - line);
+        if (colon) {
+            size_t len = (size_t)(colon - line);
+            const char *p = colon + 1;
+            unsigned long long *field = nullptr;
+            if (len == 5 && memcmp(line, "syscr", 5) == 0) field = &io.syscr;
+            else if (len == 5 && memcmp(line, "syscw", 5) == 0) field = &io.syscw;
+            else if (len == 10 && memcmp(line, "read_bytes", 10) == 0) field = &io.read_bytes;
+            else if (len == 11 && memcmp(line, "write_bytes", 11) == 0) field = &io.write_bytes;
+            if (field) next_num(p, eol, *field);
+        }
+        line = eol + 1;
+    }
+    t.io_ok[row] = 1;
+}
+
+// Fill row `row` of the table for one PID. Every column is written, since
+// rows are reused from the previous tick. Returns false if the process
+// could not be read (it has most likely exited).
+bool read_process_basic(int pid, PidHandles &h, ProcTable &t, size_t row) {
+    t.pid[row] = pid;
+    t.ppid[row] = 0;
+    t.time[row] = 0;
+    t.rss_pages[row] = 0;
+    t.comm[row][0] = '\0';
+    char buf[1024];
+
+    // name (same as /proc/<pid>/comm), ppid(4) and utime(14) + stime(15) from stat
+    ssize_t n = pid_handles.read(pid, h, h.stat_fd, "stat", buf, sizeof(buf));
+    StatRecord sr;
+    bool alive = n > 0 && parse_stat_line(buf, (size_t)n, sr);
+    if (alive) {
+        memcpy(t.comm[row].data(), sr.comm, sizeof(sr.comm));
+        t.ppid[row] = sr.ppid;
+        t.time[row] = (unsigned long long)sr.utime + sr.stime;
+        h.start_time = sr.starttime;
+        read_process_io(pid, h, t, row);
+    } else {
+        t.io[row] = IoCounters{};
+        t.io_ok[row] = 0;
+    }
+
+    t.rss_pages[row] = read_rss_pages(pid, h);
+    return alive;
+}
+
+// Fixed-size pool used to shard the per-PID reads of a scan. Each worker owns
+// a contiguous range of indices and claims chunks from it; once its own range
+// is drained it steals chunks from the other ranges. The calling thread takes
+// part as worker 0. Results are written by index, so no merge step is needed
+// and the output order is that of the input.
+struct ScanPool {
+    static constexpr size_t CHUNK = 64;
+
+    struct alignas(64) Shard {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+    };
+
+    unsigned nworkers;
+    std::unique_ptr<Shard[]> shards;
+    std::vector<std::thread> threads;
+    std::mutex m;
+    std::condition_variable cv_start, cv_done;
+    std::function<void(size_t)> job;
+    unsigned long job_gen = 0;
+    unsigned busy = 0;
+    bool stop = false;
+
+    explicit ScanPool(unsigned n) : nworkers(std::max(1u, n)), shards(new Shard[std::max(1u, n)]) {
+        for (unsigned id = 1; id < nworkers; ++id) threads.emplace_back([this, id] { worker_loop(id); });
+    }
+
+    ~ScanPool() {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            stop = true;
+        }
+        cv_start.notify_all();
+        for (auto &t : threads) t.join();
+    }
+
+    // Run fn(i) for every i in [0, n) and return once all calls finished.
+    void parallel_for(size_t n, std::function<void(size_t)> fn) {
+        if (nworkers == 1 || n <= CHUNK) {
+            for (size_t i = 0; i < n; ++i) fn(i);
+            return;
+        }
+        size_t per = (n + nworkers - 1) / nworkers;
+        for (unsigned w = 0; w < nworkers; ++w) {
+            shards[w].next.store(std::min(n, w * per), std::memory_order_relaxed);
+            shards[w].end = std::min(n, (w + 1) * per);
+        }
+        {
+            std::lock_guard<std::mutex> lk(m);
+            job = std::move(fn);
+            busy = nworkers - 1;
+            ++job_gen;
+        }
+        cv_start.notify_all();
+        drain(0);
+        std::unique_lock<std::mutex> lk(m);
+        cv_done.wait(lk, [this] { return busy == 0; });
+        job = nullptr;
+    }
+
+    void worker_loop(unsigned id) {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv_start.wait(lk, [&] { return stop || job_gen != seen; });
+                if (stop) return;
+                seen = job_gen;
+            }
+            drain(id);
+            std::lock_guard<std::mutex> lk(m);
+            if (--busy == 0) cv_done.notify_one();
+        }
+    }
+
+    // Own shard first, then steal from the others in round-robin order.
+    void drain(unsigned id) {
+        for (unsigned k = 0; k < nworkers; ++k) {
+            Shard &s = shards[(id + k) % nworkers];
+            while (true) {
+                size_t i = s.next.fetch_add(CHUNK, std::memory_order_relaxed);
+                if (i >= s.end) break;
+                size_t stop_at = std::min(s.end, i + CHUNK);
+                for (; i < stop_at; ++i) job(i);
+            }
+        }
+    }
+};
+
+// Live PID set kept up to date from NETLINK_CONNECTOR proc events, so a
+// tick does not have to walk /proc to find forks and exits. Only thread
+// group leaders are tracked. EXEC and COMM events do not change membership;
+// the new name is read from stat on the next tick anyway. A receive overrun
+// (ENOBUFS) loses events, so the caller must then rebuild the set from a
+// full readdir; it does so periodically as well. Needs CAP_NET_ADMIN in the
+// initial PID namespace; when open() fails the caller keeps using readdir.
+struct ProcEventSource {
+    int sock = -1;
+    std::set<int> pids;
+    bool overrun = true; // set must be (re)built from readdir
+    steady_clock::time_point last_rescan;
+    seconds rescan_interval{30};
+    unsigned long events = 0;
+
+    ~ProcEventSource() {
+        if (sock >= 0) close(sock);
+    }
+
+    bool active() const { return sock >= 0; }
+
+    bool open_socket() {
+        sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+        if (sock < 0) return false;
+        struct sockaddr_nl sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.nl_family = AF_NETLINK;
+        sa.nl_groups = CN_IDX_PROC;
+        // a fork storm can queue a lot of events between ticks
+        int rcvbuf = 4 << 20;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0)
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        if (bind(sock, (struct sockaddr *)&sa, sizeof(sa)) != 0 || !subscribe(PROC_CN_MCAST_LISTEN)) {
+            close(sock);
+            sock = -1;
+            return false;
+        }
+        overrun = true;
+        return true;
+    }
+
+    bool subscribe(enum proc_cn_mcast_op op) {
+        alignas(struct nlmsghdr) char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))];
+        memset(buf, 0, sizeof(buf));
+        struct nlmsghdr *nh = (struct nlmsghdr *)buf;
+        nh->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+        nh->nlmsg_type = NLMSG_DONE;
+        nh->nlmsg_pid = 0;
+        struct cn_msg *cn = (struct cn_msg *)NLMSG_DATA(nh);
+        cn->id.idx = CN_IDX_PROC;
+        cn->id.val = CN_VAL_PROC;
+        cn->len = sizeof(op);
+        memcpy(cn->data, &op, sizeof(op));
+        return send(sock, buf, nh->nlmsg_len, 0) == (ssize_t)nh->nlmsg_len;
+    }
+
+    // Apply every queued event without blocking.
+    void drain() {
+        alignas(struct nlmsghdr) char buf[16384];
+        while (true) {
+            ssize_t n = recv(sock, buf, sizeof(buf), 0);
+            if (n < 0) {
+                if (errno == ENOBUFS) {
+                    overrun = true; // events were dropped; keep draining
+                    continue;
+                }
+                if (errno == EINTR) continue;
+                return; // EAGAIN: queue empty
+            }
+            if (n == 0) return;
+            for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (size_t)n); nh = NLMSG_NEXT(nh, n)) {
+                if (nh->nlmsg_type == NLMSG_ERROR || nh->nlmsg_type == NLMSG_NOOP) continue;
+                struct cn_msg *cn = (struct cn_msg *)NLMSG_DATA(nh);
+                if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) continue;
+                const struct proc_event *ev = (const struct proc_event *)cn->data;
+                ++events;
+                switch (ev->what) {
+                case proc_event::PROC_EVENT_FORK:
+                    if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid)
+                        pids.insert(ev->event_data.fork.child_tgid);
+                    break;
+                case proc_event::PROC_EVENT_EXIT:
+                    if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid)
+                        pids.erase(ev->event_data.exit.process_tgid);
+                    break;
+                case proc_event::PROC_EVENT_EXEC:
+                case proc_event::PROC_EVENT_COMM:
+                default:
+                    break;
+                }
+            }
+        }
+    }
+
+    bool rescan_due() const { return overrun || steady_clock::now() - last_rescan >= rescan_interval; }
+
+    // Replace the set with the result of a full readdir.
+    void reset(const std::vector<int> &scanned) {
+        pids.clear();
+        pids.insert(scanned.begin(), scanned.end());
+        overrun = false;
+        last_rescan = steady_clock::now();
+    }
+};
+
+static ProcEventSource proc_events;
+
+// Per-process accounting from the taskstats generic-netlink family, used
+// instead of parsing /proc/<pid>/stat when --taskstats is given.
+struct TaskStatsRecord {
+    int tgid = 0;
+    int ppid = 0;
+    unsigned long long btime = 0; // start time, seconds since the epoch
+    char comm[TS_COMM_LEN] = {0};
+    unsigned long long cpu_run_ns = 0; // scheduler runtime (sum_exec_runtime), ns
+    TaskAcct acct;                     // delays summed over threads, leader's high-water marks
+};
+
+// Taskstats client. Each process costs two queries: per thread group
+// (TASKSTATS_CMD_ATTR_TGID) for CPU time and delays summed over all threads,
+// and per leader task (TASKSTATS_CMD_ATTR_PID) for the name, parent, start
+// time and memory high-water marks, which the kernel leaves out of the group
+// aggregate.
+// Queries are pipelined: a batch goes out in one sendmmsg() and the replies
+// come back through recvmmsg(), matched by sequence number. Getting
+// the family id fails (and the caller keeps the /proc parser) on kernels
+// without CONFIG_TASKSTATS; the queries themselves need CAP_NET_ADMIN.
+struct TaskStatsClient {
+    static constexpr size_t BATCH = 128; // processes per round trip (2 messages each)
+    static constexpr size_t REQ_SIZE = NLMSG_SPACE(GENL_HDRLEN + NLA_HDRLEN + NLA_ALIGN(sizeof(uint32_t)));
+    static constexpr size_t REPLY_SIZE = 1024;
+
+    int sock = -1;
+    uint16_t family = 0;
+    uint32_t seq_base = 0;
+    std::vector<char> req_buf;
+    std::vector<char> reply_buf;
+
+    ~TaskStatsClient() {
+        if (sock >= 0) close(sock);
+    }
+
+    bool active() const { return sock >= 0; }
+
+    static struct nlattr *put_attr(struct nlmsghdr *nh, uint16_t type, const void *data, size_t len) {
+        struct nlattr *na = (struct nlattr *)((char *)nh + NLMSG_ALIGN(nh->nlmsg_len));
+        na->nla_type = type;
+        na->nla_len = (uint16_t)(NLA_HDRLEN + len);
+        memcpy((char *)na + NLA_HDRLEN, data, len);
+        nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + NLA_ALIGN(na->nla_len);
+        return na;
+    }
+
+    static void init_msg(struct nlmsghdr *nh, uint16_t type, uint8_t cmd, uint32_t seq) {
+        nh->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+        nh->nlmsg_type = type;
+        nh->nlmsg_flags = NLM_F_REQUEST;
+        nh->nlmsg_seq = seq;
+        nh->nlmsg_pid = 0;
+        struct genlmsghdr *gh = (struct genlmsghdr *)NLMSG_DATA(nh);
+        gh->cmd = cmd;
+        gh->version = 1;
+        gh->reserved = 0;
+    }
+
+    bool open_socket() {
+        sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+        if (sock < 0) return false;
+        int rcvbuf = 4 << 20;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        struct timeval tv = {1, 0}; // never hang a tick on a lost reply
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        struct sockaddr_nl sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.nl_family = AF_NETLINK;
+        if (bind(sock, (struct sockaddr *)&sa, sizeof(sa)) != 0 || !resolve_family()) {
+            close(sock);
+            sock = -1;
+            return false;
+        }
+        req_buf.resize(2 * BATCH * REQ_SIZE);
+        reply_buf.resize(2 * BATCH * REPLY_SIZE);
+        return true;
+    }
+
+    // Look up the dynamic family id of "TASKSTATS" through the genl controller.
+    bool resolve_family() {
+        alignas(struct nlmsghdr) char buf[4096];
+        memset(buf, 0, 256);
+        struct nlmsghdr *nh = (struct nlmsghdr *)buf;
+        init_msg(nh, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 1);
+        put_attr(nh, CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME));
+        if (send(sock, buf, nh->nlmsg_len, 0) != (ssize_t)nh->nlmsg_len) return false;
+        ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n <= 0 || !NLMSG_OK(nh, (size_t)n) || nh->nlmsg_type == NLMSG_ERROR) return false;
+        int len = (int)nh->nlmsg_len - (int)NLMSG_LENGTH(GENL_HDRLEN);
+        struct nlattr *na = (struct nlattr *)((char *)NLMSG_DATA(nh) + GENL_HDRLEN);
+        for (; len >= (int)NLA_HDRLEN && na->nla_len >= NLA_HDRLEN; len -= NLA_ALIGN(na->nla_len),
+             na = (struct nlattr *)((char *)na + NLA_ALIGN(na->nla_len))) {
+            if ((na->nla_type & NLA_TYPE_MASK) == CTRL_ATTR_FAMILY_ID) {
+                memcpy(&family, (char *)na + NLA_HDRLEN, sizeof(family));
+                return family != 0;
+            }
+        }
+        return false;
+    }
+
+    // Decode one reply into r: the group aggregate fills the CPU time and
+    // delays, the leader task's reply the name, parent, start time and
+    // high-water marks. Returns
+    // false for errors (e.g. ESRCH) and foreign messages.
+    static bool parse_reply(const struct nlmsghdr *nh, TaskStatsRecord &r) {
+        if (nh->nlmsg_type == NLMSG_ERROR || nh->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) return false;
+        int len = (int)nh->nlmsg_len - (int)NLMSG_LENGTH(GENL_HDRLEN);
+        const struct nlattr *na = (const struct nlattr *)((const char *)NLMSG_DATA(nh) + GENL_HDRLEN);
+        for (; len >= (int)NLA_HDRLEN && na->nla_len >= NLA_HDRLEN; len -= NLA_ALIGN(na->nla_len),
+             na = (const struct nlattr *)((const char *)na + NLA_ALIGN(na->nla_len))) {
+            int type = na->nla_type & NLA_TYPE_MASK;
+            if (type != TASKSTATS_TYPE_AGGR_TGID && type != TASKSTATS_TYPE_AGGR_PID) continue;
+            bool group = type == TASKSTATS_TYPE_AGGR_TGID;
+            // nested: TASKSTATS_TYPE_TGID or _PID, then TASKSTATS_TYPE_STATS
+            int nlen = (int)na->nla_len - (int)NLA_HDRLEN;
+            const struct nlattr *in = (const struct nlattr *)((const char *)na + NLA_HDRLEN);
+            for (; nlen >= (int)NLA_HDRLEN && in->nla_len >= NLA_HDRLEN; nlen -= NLA_ALIGN(in->nla_len),
+                 in = (const struct nlattr *)((const char *)in + NLA_ALIGN(in->nla_len))) {
+                const char *data = (const char *)in + NLA_HDRLEN;
+                size_t dlen = in->nla_len - NLA_HDRLEN;
+                if ((in->nla_type & NLA_TYPE_MASK) != TASKSTATS_TYPE_STATS) continue;
+                // older kernels send a shorter struct; missing fields stay zero
+                struct taskstats ts;
+                memset(&ts, 0, sizeof(ts));
+                memcpy(&ts, data, std::min(dlen, sizeof(ts)));
+                if (group) {
+                    r.cpu_run_ns = ts.cpu_run_virtual_total;
+                    r.acct.cpu_delay_ns = ts.cpu_delay_total;
+                    r.acct.blkio_delay_ns = ts.blkio_delay_total;
+                    r.acct.swapin_delay_ns = ts.swapin_delay_total;
+                } else {
+                    memcpy(r.comm, ts.ac_comm, sizeof(r.comm));
+                    r.comm[sizeof(r.comm) - 1] = '\0';
+                    r.ppid = (int)ts.ac_ppid;
+                    r.btime = ts.ac_btime;
+                    r.acct.hiwater_rss_kb = ts.hiwater_rss;
+                    r.acct.hiwater_vm_kb = ts.hiwater_vm;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Fetch records for every tgid; ok[i] is 0 where the group query failed.
+    void query(const std::vector<int> &tgids, std::vector<TaskStatsRecord> &out, std::vector<char> &ok) {
+        out.assign(tgids.size(), TaskStatsRecord{});
+        ok.assign(tgids.size(), 0);
+        struct mmsghdr msgs[2 * BATCH];
+        struct iovec iovs[2 * BATCH];
+        for (size_t base = 0; base < tgids.size(); base += BATCH) {
+            // message 2k asks for process k's group, 2k + 1 for its leader
+            size_t count = 2 * std::min(BATCH, tgids.size() - base);
+            seq_base += (uint32_t)(2 * BATCH);
+            memset(req_buf.data(), 0, count * REQ_SIZE);
+            memset(msgs, 0, sizeof(msgs));
+            for (size_t k = 0; k < count; ++k) {
+                struct nlmsghdr *nh = (struct nlmsghdr *)(req_buf.data() + k * REQ_SIZE);
+                init_msg(nh, family, TASKSTATS_CMD_GET, seq_base + (uint32_t)k);
+                uint32_t id = (uint32_t)tgids[base + k / 2];
+                put_attr(nh, (k & 1) ? TASKSTATS_CMD_ATTR_PID : TASKSTATS_CMD_ATTR_TGID, &id, sizeof(id));
+                iovs[k].iov_base = nh;
+                iovs[k].iov_len = nh->nlmsg_len;
+                msgs[k].msg_hdr.msg_iov = &iovs[k];
+                msgs[k].msg_hdr.msg_iovlen = 1;
+            }
+            size_t sent = 0;
+            while (sent < count) {
+                int r = sendmmsg(sock, msgs + sent, (unsigned)(count - sent), 0);
+                if (r <= 0) break;
+                sent += (size_t)r;
+            }
+            // one reply (stats or error) per request sent
+            size_t received = 0;
+            while (received < sent) {
+                memset(msgs, 0, sizeof(msgs));
+                size_t want = sent - received;
+                for (size_t k = 0; k < want; ++k) {
+                    iovs[k].iov_base = reply_buf.data() + k * REPLY_SIZE;
+                    iovs[k].iov_len = REPLY_SIZE;
+                    msgs[k].msg_hdr.msg_iov = &iovs[k];
+                    msgs[k].msg_hdr.msg_iovlen = 1;
+                }
+                int got = recvmmsg(sock, msgs, (unsigned)want, MSG_WAITFORONE, nullptr);
+                if (got <= 0) break; // timeout: leave the rest marked failed
+                for (int k = 0; k < got; ++k) {
+                    const struct nlmsghdr *nh = (const struct nlmsghdr *)iovs[k].iov_base;
+                    if (!NLMSG_OK(nh, msgs[k].msg_len)) continue;
+                    uint32_t idx = nh->nlmsg_seq - seq_base;
+                    if (idx >= count) continue; // late reply from an earlier batch
+                    TaskStatsRecord &rec = out[base + idx / 2];
+                    rec.tgid = tgids[base + idx / 2];
+                    bool parsed = parse_reply(nh, rec);
+                    if (!(idx & 1)) ok[base + idx / 2] = parsed;
+                }
+                received += (size_t)got;
+            }
+        }
+    }
+};
+
+static TaskStatsClient taskstats;
+
+// Fill row `row` from a taskstats record: CPU time in ns plus the delay and
+// high-water accounting. RSS and I/O still come from statm and io, since the
+// taskstats I/O fields only cover the leader thread and are rounded down to
+// whole kB.
+void fill_from_taskstats(int pid, const TaskStatsRecord &ts, PidHandles &h, ProcTable &t, size_t row) {
+    t.pid[row] = pid;
+    t.ppid[row] = ts.ppid;
+    t.time[row] = ts.cpu_run_ns;
+    h.start_time = ts.btime;
+    memcpy(t.comm[row].data(), ts.comm, sizeof(ts.comm));
+    t.acct[row] = ts.acct;
+    t.rss_pages[row] = read_rss_pages(pid, h);
+    read_process_io(pid, h, t, row);
+}
+
+// Number of scan workers; 0 means one per online CPU. Set from the command
+// line before the first scan.
+static unsigned scan_threads = 0;
+
+// Adaptive sampling: a PID whose CPU time, RSS and I/O did not change since its
+// last read is read again after 2, then 4, then at most 8 ticks; any change
+// puts it back on every tick. Off with --full-scan.
+static bool adaptive_sampling = true;
+static const uint8_t MAX_IDLE_LEVEL = 3;
+
+// PIDs on screen, published by the UI after each sort; the scan reads them
+// every tick whatever their idle level.
+struct VisiblePids {
+    std::mutex m;
+    std::vector<int> pids;
+
+    void set(const std::vector<int> &v) {
+        std::lock_guard<std::mutex> lk(m);
+        pids = v;
+    }
+
+    void get(std::vector<int> &out) {
+        std::lock_guard<std::mutex> lk(m);
+        out = pids;
+    }
+};
+static VisiblePids visible_pids;
+
+// Record a fresh read of `row` in the PID's cache entry and schedule the
+// next one: back to every tick on any change, otherwise one level sparser.
+// Idle reads land on ticks where (tick + pid) is a multiple of the period,
+// so the idle population is spread evenly rather than read all at once.
+void remember_sample(PidHandles &h, const ProcTable &t, size_t row, uint64_t tick) {
+    bool active = !h.sampled || t.time[row] != h.time || t.rss_pages[row] != h.rss_pages ||
+                  t.io[row].read_bytes != h.io.read_bytes || t.io[row].write_bytes != h.io.write_bytes ||
+                  t.io[row].syscr != h.io.syscr || t.io[row].syscw != h.io.syscw;
+    h.idle_level = active ? 0 : (uint8_t)std::min<int>(h.idle_level + 1, MAX_IDLE_LEVEL);
+    uint64_t period = 1u << h.idle_level;
+    h.due = tick + period - ((tick + (uint64_t)t.pid[row]) & (period - 1));
+    h.sampled = true;
+    h.ppid = t.ppid[row];
+    h.time = t.time[row];
+    h.rss_pages = t.rss_pages[row];
+    h.comm = t.comm[row];
+    h.io = t.io[row];
+    h.io_ok = t.io_ok[row];
+    h.acct = t.acct[row];
+}
+
+// Set by the UI while the cgroup view is shown; PIDs are only mapped to
+// cgroups then.
+static std::atomic<bool> cgroup_view{false};
+
+// Look up the PID's cgroup v2 path ("0::<path>" in /proc/<pid>/cgroup)
+// unless the cached one belongs to the same process instance.
+void refresh_cgroup(int pid, PidHandles &h) {
+    if (h.cgroup_start == h.start_time) return;
+    h.cgroup_start = h.start_time;
+    h.cgroup.clear();
+    char path[256];
+    char buf[4096];
+    snprintf(path, sizeof(path), "%s/%d/cgroup", proc_root.c_str(), pid);
+    ssize_t n = read_small_file(path, buf, sizeof(buf));
+    for (const char *line = buf; n > 0 && line < buf + n;) {
+        const char *eol = (const char *)memchr(line, '\n', buf + n - line);
+        if (!eol) eol = buf + n;
+        if (eol - line >= 3 && memcmp(line, "0::", 3) == 0) {
+            h.cgroup.assign(line + 3, eol);
+            break;
+        }
+        line = eol + 1;
+    }
+}
+
+// Set by the UI while the socket columns are shown; descriptors are only
+// walked then.
+static std::atomic<bool> socket_view{false};
+
+// One TCP or UDP socket of our network namespace.
+struct SockInfo {
+    uint64_t inode = 0;
+    uint32_t rx_queue = 0;
+    uint32_t tx_queue = 0;
+    bool udp = false;
+};
+
+// Every TCP and UDP socket (IPv4 and IPv6) by inode, rebuilt each tick. The
+// dump comes from NETLINK_SOCK_DIAG where the kernel has a diag module for
+// the protocol (tcp_diag, udp_diag) and from the /proc/net text files
+// otherwise; a source that fails once is not tried again. Only sockets of
+// our own network namespace are visible, so processes in other namespaces
+// show none.
+struct SocketTable {
+    struct Source {
+        int family;
+        int protocol;
+        const char *proc_file;
+        bool diag;
+    };
+
+    Source sources[4] = {{AF_INET, IPPROTO_TCP, "net/tcp", true},
+                         {AF_INET6, IPPROTO_TCP, "net/tcp6", true},
+                         {AF_INET, IPPROTO_UDP, "net/udp", true},
+                         {AF_INET6, IPPROTO_UDP, "net/udp6", true}};
+    int sock = -1;
+    uint32_t seq = 0;
+    std::vector<SockInfo> socks; // sorted by inode
+    std::vector<char> buf;
+
+    SocketTable() {
+        buf.resize(65536);
+        sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    }
+
+    ~SocketTable() {
+        if (sock >= 0) close(sock);
+    }
+
+    SocketTable(const SocketTable &) = delete;
+    SocketTable &operator=(const SocketTable &) = delete;
+
+    void refresh() {
+        socks.clear();
+        for (Source &src : sources) {
+            if (src.diag && sock >= 0 && dump_diag(src)) continue;
+            src.diag = false;
+            read_proc(src);
+        }
+        std::sort(socks.begin(), socks.end(), [](const SockInfo &a, const SockInfo &b) { return a.inode < b.inode; });
+    }
+
+    const SockInfo *find(uint64_t inode) const {
+        auto it = std::lower_bound(socks.begin(), socks.end(), inode,
+                                   [](const SockInfo &s, uint64_t v) { return s.inode < v; });
+        return it != socks.end() && it->inode == inode ? &*it : nullptr;
+    }
+
+    bool dump_diag(const Source &src) {
+        struct {
+            struct nlmsghdr nh;
+            struct inet_diag_req_v2 req;
+        } msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.nh.nlmsg_len = sizeof(msg);
+        msg.nh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+        msg.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        msg.nh.nlmsg_seq = ++seq;
+        msg.req.sdiag_family = (uint8_t)src.family;
+        msg.req.sdiag_protocol = (uint8_t)src.protocol;
+        msg.req.idiag_states = ~0U;
+        if (send(sock, &msg, sizeof(msg), 0) != (ssize_t)sizeof(msg)) return false;
+        const size_t start = socks.size();
+        while (true) {
+            ssize_t n = recv(sock, buf.data(), buf.size(), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            for (struct nlmsghdr *nh = (struct nlmsghdr *)buf.data(); NLMSG_OK(nh, (size_t)n); nh = NLMSG_NEXT(nh, n)) {
+                if (nh->nlmsg_seq != seq) continue;
+                if (nh->nlmsg_type == NLMSG_DONE) return true;
+                if (nh->nlmsg_type == NLMSG_ERROR) {
+                    socks.resize(start);
+                    return false;
+                }
+                const struct inet_diag_msg *m = (const struct inet_diag_msg *)NLMSG_DATA(nh);
+                if (m->idiag_inode == 0) continue; // TIME_WAIT and other orphans
+                SockInfo s;
+                s.inode = m->idiag_inode;
+                s.rx_queue = m->idiag_rqueue;
+                // for a listener wqueue is the backlog limit, not queued data
+                s.tx_queue = m->idiag_state == 10 /* TCP_LISTEN */ ? 0 : m->idiag_wqueue;
+                s.udp = src.protocol == IPPROTO_UDP;
+                socks.push_back(s);
+            }
+        }
+        socks.resize(start);
+        return false;
+    }
+
+    // "sl local rem st tx_queue:rx_queue tr:when retrnsmt uid timeout inode ..."
+    // with the queues in hex
+    void read_proc(const Source &src) {
+        int fd = open(proc_path(src.proc_file).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        std::string text;
+        ssize_t n;
+        while ((n = read(fd, buf.data(), buf.size())) > 0) text.append(buf.data(), (size_t)n);
+        close(fd);
+        const char *p = text.c_str();
+        const char *end = p + text.size();
+        const char *nl = (const char *)memchr(p, '\n', end - p); // header
+        p = nl ? nl + 1 : end;
+        while (p < end) {
+            const char *eol = (const char *)memchr(p, '\n', end - p);
+            if (!eol) eol = end;
+            const char *tok[10];
+            int ntok = 0;
+            for (const char *q = p; q < eol && ntok < 10;) {
+                while (q < eol && *q == ' ') ++q;
+                if (q < eol) tok[ntok++] = q;
+                while (q < eol && *q != ' ') ++q;
+            }
+            unsigned long long inode = 0;
+            const char *q = ntok == 10 ? tok[9] : nullptr;
+            if (q && next_num(q, eol, inode) && inode != 0) {
+                SockInfo s;
+                s.inode = inode;
+                char *qend;
+                s.tx_queue = (uint32_t)strtoul(tok[4], &qend, 16);
+                s.rx_queue = *qend == ':' ? (uint32_t)strtoul(qend + 1, nullptr, 16) : 0;
+                if (strtoul(tok[3], nullptr, 16) == 10) s.tx_queue = 0; // listener, as above
+                s.udp = src.protocol == IPPROTO_UDP;
+                socks.push_back(s);
+            }
+            p = eol + 1;
+        }
+    }
+};
+
+// Totals over the sockets behind pid's descriptors. Walking /proc/<pid>/fd
+// is the expensive part, so the descriptor list is re-read only every 4
+// ticks (phased by PID), and only descriptors that are new since the last
+// walk, or whose socket has gone, are readlink()ed; every 8th walk resolves
+// them all again, for numbers reused by other kinds of file.
+void refresh_sockets(int pid, PidHandles &h, uint64_t tick, const SocketTable &table, SockSummary &out) {
+    out = SockSummary{};
+    if (h.fd_denied_start == h.start_time) return;
+    if (tick >= h.fds_due) {
+        static thread_local std::vector<int> listed;
+        static thread_local std::vector<std::pair<int, uint64_t>> next;
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%d/fd", proc_root.c_str(), pid);
+        DIR *d = opendir(path);
+        if (!d) {
+            if (errno == EACCES || errno == EPERM) h.fd_denied_start = h.start_time;
+            h.fds.clear();
+            return;
+        }
+        listed.clear();
+        struct dirent *entry;
+        while ((entry = readdir(d)) != nullptr) {
+            if (is_digits(entry->d_name)) listed.push_back(atoi(entry->d_name));
+        }
+        closedir(d);
+        std::sort(listed.begin(), listed.end());
+
+        const bool full = h.fd_walks++ % 8 == 0;
+        next.clear();
+        size_t j = 0;
+        for (int fd : listed) {
+            while (j < h.fds.size() && h.fds[j].first < fd) ++j;
+            if (!full && j < h.fds.size() && h.fds[j].first == fd &&
+                (h.fds[j].second == 0 || table.find(h.fds[j].second))) {
+                next.push_back(h.fds[j]);
+                continue;
+            }
+            // "socket:[<inode>]"
+            char link[64];
+            snprintf(path, sizeof(path), "%s/%d/fd/%d", proc_root.c_str(), pid, fd);
+            ssize_t n = readlink(path, link, sizeof(link) - 1);
+            unsigned long long inode = 0;
+            if (n > 8 && memcmp(link, "socket:[", 8) == 0) {
+                const char *c = link + 8;
+                next_num(c, link + n, inode);
+            }
+            next.emplace_back(fd, inode);
+        }
+        h.fds.assign(next.begin(), next.end());
+        h.fds_due = tick + 4 - ((tick + (uint64_t)pid) & 3);
+    }
+    out.ok = true;
+    for (const auto &f : h.fds) {
+        const SockInfo *s = f.second ? table.find(f.second) : nullptr;
+        if (!s) continue;
+        if (s->udp) ++out.udp;
+        else ++out.tcp;
+        out.rx_queue += s->rx_queue;
+        out.tx_queue += s->tx_queue;
+    }
+}
+
+// Set by the UI while the memory detail columns are shown. smaps_rollup
+// makes the kernel walk every mapping of the process, so it is only read
+// for processes on screen, and at most every smaps_interval seconds each
+// (--smaps-interval).
+static std::atomic<bool> smaps_view{false};
+static double smaps_interval = 5.0;
+
+// PSS, USS, shared and swap totals of one process. Returns false with errno
+// set if the file could not be read: EACCES/EPERM for other users'
+// processes, ESRCH for kernel threads, which have no memory map.
+bool read_smaps_rollup(int pid, MemDetail &out) {
+    out = MemDetail{};
+    char path[256];
+    char buf[2048];
+    snprintf(path, sizeof(path), "%s/%d/smaps_rollup", proc_root.c_str(), pid);
+    ssize_t n = read_small_file(path, buf, sizeof(buf));
+    if (n <= 0) {
+        if (n == 0) errno = ESRCH;
+        return false;
+    }
+    unsigned long long private_clean = 0, private_dirty = 0, shared_clean = 0, shared_dirty = 0;
+    const char *end = buf + n;
+    for (const char *line = buf; line < end;) {
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        const char *colon = (const char *)memchr(line, ':', eol - line);
+        if (colon) {
+            size_t len = (size_t)(colon - line);
+            const char *p = colon + 1;
+            auto is = [&](const char *key) { return strlen(key) == len && memcmp(line, key, len) == 0; };
+            if (is("Pss")) next_num(p, eol, out.pss_kb);
+            else if (is("Private_Clean")) next_num(p, eol, private_clean);
+            else if (is("Private_Dirty")) next_num(p, eol, private_dirty);
+            else if (is("Shared_Clean")) next_num(p, eol, shared_clean);
+            else if (is("Shared_Dirty")) next_num(p, eol, shared_dirty);
+            else if (is("Swap")) next_num(p, eol, out.swap_kb);
+        }
+        line = eol + 1;
+    }
+    out.uss_kb = private_clean + private_dirty;
+    out.shared_kb = shared_clean + shared_dirty;
+    out.ok = true;
+    return true;
+}
+
+// Fill `row` from the cache entry without touching /proc.
+void carry_over(int pid, const PidHandles &h, ProcTable &t, size_t row) {
+    t.pid[row] = pid;
+    t.ppid[row] = h.ppid;
+    t.time[row] = h.time;
+    t.rss_pages[row] = h.rss_pages;
+    t.comm[row] = h.comm;
+    t.io[row] = h.io;
+    t.io_ok[row] = h.io_ok;
+    t.acct[row] = h.acct;
+    t.stale[row] = 1;
+}
+
+ScanPool &scan_pool() {
+    static ScanPool pool(scan_threads ? scan_threads : (unsigned)std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)));
+    return pool;
+}
+
+// Intern the raw comm column; start over if exited processes have left the
+// pool much larger than the table.
+void intern_names(ProcTable &t) {
+    if (t.names.size() > 4 * t.size() + 1024) t.names.clear();
+    for (size_t i = 0; i < t.size(); ++i) t.name_id[i] = t.names.intern(t.comm[i].data());
+}
+
+// Per-process columns that are only collected while their view is shown.
+// The UI flags are read once per sample into this, so the scan and what the
+// snapshot claims to hold agree even if the UI flips a flag meanwhile.
+struct ProcViews {
+    bool cgroups = false; // cgroup_id and the cgroups pool
+    bool sockets = false; // socks
+    bool smaps = false;   // smaps
+};
+
+// Refill `procs` with one row per live PID, plus the columns of the views
+// in `views`.
+void get_all_processes(ProcTable &procs, const ProcViews &views) {
+    ScanPool &pool = scan_pool();
+    static uint64_t tick = 0;
+    static std::vector<int> pinned;
+    ++tick;
+
+    // collect the PID list first; handle cache entries are created here on
+    // the calling thread so the workers never modify the map
+    std::vector<int> pids;
+    std::vector<PidHandles *> handles;
+    {
+        PhaseTimer timer(PH_SCAN);
+        // with proc events, take the PID list from the event-maintained set
+        // and only walk /proc after an overrun or at the rescan interval
+        if (proc_events.active()) proc_events.drain();
+        if (proc_events.active() && !proc_events.rescan_due()) {
+            pids.assign(proc_events.pids.begin(), proc_events.pids.end());
+        } else {
+            DIR *d = opendir(proc_root.c_str());
+            if (!d) {
+                procs.resize(0);
+                return;
+            }
+            struct dirent *entry;
+            while ((entry = readdir(d)) != nullptr) {
+                if (is_digits(entry->d_name)) pids.push_back(atoi(entry->d_name));
+            }
+            closedir(d);
+            if (proc_events.active()) proc_events.reset(pids);
+        }
+        pid_handles.begin_scan();
+        for (int pid : pids) handles.push_back(&pid_handles.touch(pid));
+        // drop cached descriptors for PIDs that have exited; entries
+        // touched above are kept, so `handles` stays valid
+        pid_handles.end_scan();
+
+        // on-screen PIDs are due whatever their idle level
+        if (adaptive_sampling) {
+            visible_pids.get(pinned);
+            for (int pid : pinned) {
+                auto it = pid_handles.entries.find(pid);
+                if (it != pid_handles.entries.end()) it->second.due = 0;
+            }
+        }
+    }
+
+    PhaseTimer timer(PH_PARSE);
+    // each worker fills its own rows; many pids might vanish between reads.
+    // Rows not due this tick are carried over from the cache and count as
+    // alive, since the PID was just listed.
+    procs.resize(pids.size());
+    std::vector<char> alive(pids.size());
+    auto is_due = [&](size_t i) { return !adaptive_sampling || handles[i]->due <= tick; };
+    if (taskstats.active()) {
+        // CPU time and names in one pipelined netlink batch for the due
+        // PIDs, RSS from statm
+        static std::vector<int> query_pids;
+        static std::vector<size_t> query_row; // row -> index into query_pids
+        static std::vector<TaskStatsRecord> records;
+        static std::vector<char> query_alive;
+        query_pids.clear();
+        query_row.resize(pids.size());
+        for (size_t i = 0; i < pids.size(); ++i) {
+            if (!is_due(i)) continue;
+            query_row[i] = query_pids.size();
+            query_pids.push_back(pids[i]);
+        }
+        taskstats.query(query_pids, records, query_alive);
+        procs.time_hz = 1e9;
+        pool.parallel_for(pids.size(), [&](size_t i) {
+            PidHandles &h = *handles[i];
+            if (!is_due(i)) {
+                carry_over(pids[i], h, procs, i);
+                alive[i] = 1;
+                return;
+            }
+            procs.stale[i] = 0;
+            alive[i] = query_alive[query_row[i]];
+            if (alive[i]) {
+                fill_from_taskstats(pids[i], records[query_row[i]], h, procs, i);
+                remember_sample(h, procs, i, tick);
+            } else {
+                procs.pid[i] = pids[i];
+                procs.ppid[i] = 0;
+                procs.time[i] = 0;
+                procs.rss_pages[i] = 0;
+                procs.comm[i][0] = '\0';
+                procs.io[i] = IoCounters{};
+                procs.io_ok[i] = 0;
+                procs.acct[i] = TaskAcct{};
+            }
+        });
+    } else {
+        procs.time_hz = (double)CLK_TCK;
+        pool.parallel_for(pids.size(), [&](size_t i) {
+            PidHandles &h = *handles[i];
+            if (!is_due(i)) {
+                carry_over(pids[i], h, procs, i);
+                alive[i] = 1;
+                return;
+            }
+            procs.stale[i] = 0;
+            alive[i] = read_process_basic(pids[i], h, procs, i);
+            if (alive[i]) remember_sample(h, procs, i, tick);
+        });
+    }
+    // an exit event can be missed (e.g. the leader exited before its
+    // threads); forget PIDs that could not be read
+    if (proc_events.active()) {
+        for (size_t i = 0; i < pids.size(); ++i) {
+            if (!alive[i]) proc_events.pids.erase(pids[i]);
+        }
+    }
+
+    // intern names on this thread
+    intern_names(procs);
+
+    // cgroup of each PID, cached per process instance
+    if (views.cgroups) {
+        pool.parallel_for(pids.size(), [&](size_t i) {
+            if (alive[i]) refresh_cgroup(pids[i], *handles[i]);
+        });
+        if (procs.cgroups.size() > 4 * procs.size() + 1024) procs.cgroups.clear();
+        for (size_t i = 0; i < procs.size(); ++i) procs.cgroup_id[i] = procs.cgroups.intern(handles[i]->cgroup.c_str());
+    }
+
+    // sockets behind each PID's descriptors, against this tick's socket dump
+    if (views.sockets) {
+        static SocketTable sockets;
+        sockets.refresh();
+        pool.parallel_for(pids.size(), [&](size_t i) {
+            if (alive[i]) refresh_sockets(pids[i], *handles[i], tick, sockets, procs.socks[i]);
+            else procs.socks[i] = SockSummary{};
+        });
+    }
+
+    // smaps_rollup of the processes on screen once their last read is
+    // smaps_interval old; every row shows what is cached for its process
+    if (views.smaps) {
+        static std::vector<int> shown;
+        visible_pids.get(shown);
+        const double now = duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+        for (int pid : shown) {
+            auto it = pid_handles.entries.find(pid);
+            if (it == pid_handles.entries.end()) continue; // a thread row
+            PidHandles &h = it->second;
+            if (h.smaps_denied_start == h.start_time) continue;
+            if (h.smaps_start == h.start_time && now - h.smaps_time < smaps_interval) continue;
+            if (!read_smaps_rollup(pid, h.smaps) && (errno == EACCES || errno == EPERM || errno == ESRCH))
+                h.smaps_denied_start = h.start_time;
+            h.smaps_start = h.start_time;
+            h.smaps_time = now;
+        }
+        for (size_t i = 0; i < procs.size(); ++i) {
+            const PidHandles &h = *handles[i];
+            procs.smaps[i] = h.smaps_start == h.start_time ? h.smaps : MemDetail{};
+        }
+    }
+}
+
+// Process whose threads the UI shows (0 = none); read by the collector.
+static std::atomic<int> expanded_pid{0};
+
+// Refill `threads` with one row per thread of tgid, read in parallel
+// through their own handle cache with the same adaptive schedule as
+// processes. Listing /proc/<tgid>/task is itself O(threads) in the kernel, so
+// the TID list is kept between ticks and only rebuilt when the process's
+// thread count changes, a read fails, or every 8 ticks to catch threads that
+// were replaced one for one. A tgid of 0 (nothing expanded) empties the
+// table and closes the descriptors of the last listed threads, which would
+// otherwise hold on to the fd budget shared with the process cache.
+void get_threads(int tgid, ProcTable &threads) {
+    static uint64_t tick = 0;
+    static std::vector<int> pinned;
+    static std::vector<int> tids;
+    static std::vector<PidHandles *> handles;
+    static int listed_tgid = 0;
+    static long listed_count = 0;
+    static uint64_t listed_tick = 0;
+    static std::atomic<bool> lost{false};
+    auto release = [&] {
+        threads.resize(0);
+        if (!listed_tgid) return;
+        tids.clear();
+        handles.clear();
+        thread_handles.begin_scan();
+        thread_handles.end_scan();
+        listed_tgid = 0;
+    };
+    if (tgid <= 0) {
+        release();
+        return;
+    }
+    PhaseTimer timer(PH_THREADS);
+    ++tick;
+
+    // thread count from the main thread's stat: the process-wide
+    // /proc/<tgid>/stat sums over every thread and is far slower
+    char path[256];
+    char buf[1024];
+    snprintf(path, sizeof(path), "%s/%d/task/%d/stat", proc_root.c_str(), tgid, tgid);
+    ssize_t n = read_small_file(path, buf, sizeof(buf));
+    StatRecord sr;
+    if (n <= 0 || !parse_stat_line(buf, (size_t)n, sr)) {
+        release(); // the process has exited
+        return;
+    }
+    if (tgid != listed_tgid || sr.num_threads != listed_count || lost || tick - listed_tick >= 8) {
+        tids.clear();
+        handles.clear();
+        snprintf(path, sizeof(path), "%s/%d/task", proc_root.c_str(), tgid);
+        DIR *d = opendir(path);
+        if (d) {
+            struct dirent *entry;
+            while ((entry = readdir(d)) != nullptr) {
+                if (is_digits(entry->d_name)) tids.push_back(atoi(entry->d_name));
+            }
+            closedir(d);
+        }
+        thread_handles.begin_scan();
+        for (int tid : tids) handles.push_back(&thread_handles.touch(tid));
+        thread_handles.end_scan(); // also drops the threads of a previously expanded process
+        listed_tgid = tgid;
+        listed_count = sr.num_threads;
+        listed_tick = tick;
+        lost = false;
+    }
+    if (adaptive_sampling) {
+        visible_pids.get(pinned); // thread rows on screen are listed there too
+        for (int tid : pinned) {
+            auto it = thread_handles.entries.find(tid);
+            if (it != thread_handles.entries.end()) it->second.due = 0;
+        }
+    }
+
+    threads.resize(tids.size());
+    threads.time_hz = (double)CLK_TCK;
+    scan_pool().parallel_for(tids.size(), [&](size_t i) {
+        PidHandles &h = *handles[i];
+        if (adaptive_sampling && h.due > tick) carry_over(tids[i], h, threads, i);
+        else if (read_thread_basic(tgid, tids[i], h, threads, i)) remember_sample(h, threads, i, tick);
+        else lost.store(true, std::memory_order_relaxed); // exited; relist next tick
+    });
+    intern_names(threads);
+}
+
+long read_pid_max() {
+    char buf[32];
+    ssize_t n = read_small_file(proc_path("sys/kernel/pid_max").c_str(), buf, sizeof(buf));
+    const char *p = buf;
+    unsigned long long v = 0;
+    if (n <= 0 || !next_num(p, buf + n, v) || v == 0) return 32768;
+    return (long)v;
+}
+
+// Flat PID -> previous sample table, open-addressed with linear probing.
+// Each slot keeps the CPU time, I/O counters and timestamp of the PID's last
+// fresh read and the rates computed from them, so a PID read only every few
+// ticks still gets its delta over the real time span, and a skipped tick
+// keeps the last rate. Capacity is a power of two kept at or below 50% load;
+// it starts at enough room for min(pid_max, 32768) PIDs and doubles as
+// needed, but never beyond what pid_max live PIDs could need. Each key is
+// stamped with the tick that last touched it, and end_tick() evicts PIDs the
+// current scan did not see (backward-shift deletion, so no tombstones build
+// up). Keys are kept apart from the samples so probing and the eviction
+// sweep over the mostly empty table only stream 8 bytes per slot.
+struct PrevTimeTable {
+    struct Key {
+        int pid = 0; // 0 = empty
+        unsigned gen = 0;
+    };
+
+    struct Slot {
+        unsigned long long time = 0;
+        double stamp = 0.0; // when `time` was read, in seconds
+        double cpu_pct = 0.0;
+        bool io_ok = false;
+        IoCounters io;
+        IoRates io_rate;
+    };
+
+    std::vector<Key> keys;
+    std::vector<Slot> slots; // parallel to keys
+    size_t mask = 0;
+    size_t count = 0;
+    size_t max_capacity = 0;
+    unsigned gen = 0;
+
+    explicit PrevTimeTable(long pid_max) {
+        size_t cap = 1;
+        while (cap < 2 * (size_t)std::max(1L, pid_max)) cap <<= 1;
+        max_capacity = cap;
+        size_t init = 1;
+        while (init < 2 * (size_t)std::min(pid_max, 32768L)) init <<= 1;
+        keys.assign(std::min(init, max_capacity), Key{});
+        slots.assign(keys.size(), Slot{});
+        mask = keys.size() - 1;
+    }
+
+    size_t home(int pid) const { return ((uint32_t)pid * 2654435761u) & mask; }
+
+    void begin_tick() { ++gen; }
+
+    // Find or insert pid's slot and mark it seen this tick; `inserted` is
+    // set for a PID not seen before, whose slot holds no sample yet. One
+    // probe sequence per call; the reference is valid until the next call.
+    Slot &touch(int pid, bool &inserted) {
+        if ((count + 1) * 2 > keys.size() && keys.size() < max_capacity) grow();
+        for (size_t i = home(pid);; i = (i + 1) & mask) {
+            Key &k = keys[i];
+            if (k.pid == pid) {
+                k.gen = gen;
+                inserted = false;
+                return slots[i];
+            }
+            if (k.pid == 0) {
+                k.pid = pid;
+                k.gen = gen;
+                slots[i] = Slot{};
+                ++count;
+                inserted = true;
+                return slots[i];
+            }
+        }
+    }
+
+    void end_tick() {
+        for (size_t i = 0; i < keys.size();) {
+            // erase() may pull a later entry into slot i, so re-check it
+            if (keys[i].pid != 0 && keys[i].gen != gen) erase(i);
+            else ++i;
+        }
+    }
+
+    void erase(size_t i) {
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (keys[j].pid == 0) break;
+            size_t k = home(keys[j].pid);
+            // move j back into the hole unless its home lies cyclically in (i, j]
+            bool in_range = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+            if (!in_range) {
+                keys[i] = keys[j];
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        keys[i] = Key{};
+        --count;
+    }
+
+    void grow() {
+        std::vector<Key> old_keys;
+        std::vector<Slot> old_slots;
+        old_keys.swap(keys);
+        old_slots.swap(slots);
+        keys.assign(old_keys.size() * 2, Key{});
+        slots.assign(keys.size(), Slot{});
+        mask = keys.size() - 1;
+        for (size_t o = 0; o < old_keys.size(); ++o) {
+            if (old_keys[o].pid == 0) continue;
+            size_t i = home(old_keys[o].pid);
+            while (keys[i].pid != 0) i = (i + 1) & mask;
+            keys[i] = old_keys[o];
+            slots[i] = old_slots[o];
+        }
+    }
+};
+
+// Put the k smallest entries of `order` (by cmp) first, in sorted order; the
+// rest are left unordered. O(n + k log k); a full sort once k reaches n.
+template <typename Cmp>
+void select_top(std::vector<uint32_t> &order, size_t k, Cmp cmp) {
+    if (k >= order.size()) {
+        std::sort(order.begin(), order.end(), cmp);
+        return;
+    }
+    std::nth_element(order.begin(), order.begin() + k, order.end(), cmp);
+    std::sort(order.begin(), order.begin() + k, cmp);
+}
+
+// Fill `order` with 0..n-1 and move the k entries with the largest key(i) to
+// the front, in index order, for panels that show only the busiest devices.
+template <typename Key>
+void pick_busiest(std::vector<uint32_t> &order, size_t n, size_t k, Key key) {
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i) order[i] = (uint32_t)i;
+    if (n <= k) return;
+    select_top(order, k, [&key](uint32_t a, uint32_t b) {
+        if (key(a) == key(b)) return a < b;
+        return key(a) > key(b);
+    });
+    std::sort(order.begin(), order.begin() + k);
+}
+
+// Rebuild the display order: a permutation of the table's rows whose first
+// top_k entries are sorted by sort_mode (0 = CPU desc, 1 = MEM desc, 2 = PID asc,
+// 3 = disk read rate desc, 4 = disk write rate desc, 6 = PSS desc). PSS is
+// only measured for processes that have been on screen; the others sort by
+// RSS, an upper bound, so a process that may belong on screen gets there,
+// is measured, and settles at its real place.
+void sort_order(const ProcTable &procs, int sort_mode, size_t top_k, std::vector<uint32_t> &order) {
+    const size_t nprocs = procs.size();
+    order.resize(nprocs);
+    for (size_t i = 0; i < nprocs; ++i) order[i] = (uint32_t)i;
+    const int *pid_col = procs.pid.data();
+    if (sort_mode == 0) {
+        const double *key = procs.cpu_pct.data();
+        select_top(order, top_k, [key, pid_col](uint32_t a, uint32_t b) {
+            if (key[a] == key[b]) return pid_col[a] < pid_col[b];
+            return key[a] > key[b];
+        });
+    } else if (sort_mode == 1) {
+        const double *key = procs.mem_pct.data();
+        select_top(order, top_k, [key, pid_col](uint32_t a, uint32_t b) {
+            if (key[a] == key[b]) return pid_col[a] < pid_col[b];
+            return key[a] > key[b];
+        });
+    } else if (sort_mode == 6) {
+        const MemDetail *smaps = procs.smaps.data();
+        const long *rss_pages = procs.rss_pages.data();
+        const unsigned long long page_kb = (unsigned long long)PAGE_SIZE / 1024;
+        auto key = [=](uint32_t r) { return smaps[r].ok ? smaps[r].pss_kb : (unsigned long long)rss_pages[r] * page_kb; };
+        select_top(order, top_k, [key, pid_col](uint32_t a, uint32_t b) {
+            unsigned long long ka = key(a), kb = key(b);
+            if (ka == kb) return pid_col[a] < pid_col[b];
+            return ka > kb;
+        });
+    } else if (sort_mode == 3 || sort_mode == 4) {
+        const IoRates *key = procs.io_rate.data();
+        const bool reads = sort_mode == 3;
+        select_top(order, top_k, [key, pid_col, reads](uint32_t a, uint32_t b) {
+            double ka = reads ? key[a].read_bps : key[a].write_bps;
+            double kb = reads ? key[b].read_bps : key[b].write_bps;
+            if (ka == kb) return pid_col[a] < pid_col[b];
+            return ka > kb;
+        });
+    } else {
+        select_top(order, top_k, [pid_col](uint32_t a, uint32_t b) {
+            return pid_col[a] < pid_col[b];
+        });
+    }
+}
+
+void draw_bar(int y, int x, int width, double fraction) {
+    int filled = (int)(fraction * width + 0.5);
+    for (int i = 0; i < width; ++i) {
+        mvaddch(y, x + i, i < filled ? ACS_CKBOARD : ' ');
+    }
+}
+
+// One bar split into consecutive segments, each drawn with its own glyph;
+// fractions are of the whole bar and the remainder is left blank.
+void draw_stacked_bar(int y, int x, int width, const double *fractions, const chtype *glyphs, int n) {
+    int i = 0;
+    double acc = 0.0;
+    for (int s = 0; s < n; ++s) {
+        acc += std::max(0.0, fractions[s]);
+        int end = std::min(width, (int)(acc * width + 0.5));
+        for (; i < end; ++i) mvaddch(y, x + i, glyphs[s]);
+    }
+    for (; i < width; ++i) mvaddch(y, x + i, ' ');
+}
+
+// Cumulative jiffies from one "cpu" line of /proc/stat. guest and
+// guest_nice are already included in user and nice.
+struct CpuTimes {
+    unsigned long long user = 0, nice = 0, system = 0, idle = 0, iowait = 0;
+    unsigned long long irq = 0, softirq = 0, steal = 0, guest = 0, guest_nice = 0;
+};
+
+// Share of one CPU's time over the last interval, in percent.
+struct CpuUsage {
+    double busy = 0.0;   // user + nice + system + irq + softirq
+    double idle = 0.0;
+    double iowait = 0.0;
+    double steal = 0.0;
+    double guest = 0.0;  // guest + guest_nice (part of busy)
+};
+
+// Aggregate and per-core utilization from the cpu lines of /proc/stat.
+// Previous samples live in arrays sized once to the configured CPU count;
+// cores that are offline are simply absent from the file and keep online=0.
+struct CpuStat {
+    int fd = -1;
+    std::vector<char> buf;
+    int ncpus = 0;
+    CpuTimes prev_total;
+    CpuUsage total;
+    std::vector<CpuTimes> prev;
+    std::vector<CpuUsage> usage;
+    std::vector<char> online;
+
+    CpuStat() {
+        ncpus = (int)std::max(1L, sysconf(_SC_NPROCESSORS_CONF));
+        prev.resize(ncpus);
+        usage.resize(ncpus);
+        online.resize(ncpus);
+        buf.resize(16384);
+        fd = open(proc_path("stat").c_str(), O_RDONLY | O_CLOEXEC);
+        sample(); // prime the previous samples
+    }
+
+    ~CpuStat() {
+        if (fd >= 0) close(fd);
+    }
+
+    static void compute(const CpuTimes &a, const CpuTimes &b, CpuUsage &u) {
+        unsigned long long busy = (b.user - a.user) + (b.nice - a.nice) + (b.system - a.system)
+                                + (b.irq - a.irq) + (b.softirq - a.softirq);
+        unsigned long long idle = b.idle - a.idle;
+        unsigned long long iowait = b.iowait >= a.iowait ? b.iowait - a.iowait : 0; // iowait may go backwards
+        unsigned long long steal = b.steal - a.steal;
+        unsigned long long guest = (b.guest - a.guest) + (b.guest_nice - a.guest_nice);
+        double total = (double)(busy + idle + iowait + steal);
+        if (total <= 0.0) {
+            u = CpuUsage{};
+            return;
+        }
+        u.busy = 100.0 * (double)busy / total;
+        u.idle = 100.0 * (double)idle / total;
+        u.iowait = 100.0 * (double)iowait / total;
+        u.steal = 100.0 * (double)steal / total;
+        u.guest = 100.0 * (double)guest / total;
+    }
+
+    bool sample() {
+        if (fd < 0) return false;
+        // /proc/stat must be read in one go; grow the buffer until it fits
+        ssize_t n;
+        while ((n = pread(fd, buf.data(), buf.size() - 1, 0)) >= (ssize_t)buf.size() - 1) buf.resize(buf.size() * 2);
+        if (n <= 0) return false;
+        buf[n] = '\0';
+
+        std::fill(online.begin(), online.end(), 0);
+        const char *p = buf.data();
+        const char *end = p + n;
+        while (p < end && p[0] == 'c' && p[1] == 'p' && p[2] == 'u') {
+            p += 3;
+            int cpu = -1; // aggregate line
+            unsigned long long id;
+            if (p < end && *p != ' ' && next_num(p, end, id)) cpu = (int)id;
+            unsigned long long f[10] = {0};
+            for (int i = 0; i < 10 && next_num(p, end, f[i]); ++i) {}
+            CpuTimes t;
+            t.user = f[0]; t.nice = f[1]; t.system = f[2]; t.idle = f[3]; t.iowait = f[4];
+            t.irq = f[5]; t.softirq = f[6]; t.steal = f[7]; t.guest = f[8]; t.guest_nice = f[9];
+            if (cpu < 0) {
+                compute(prev_total, t, total);
+                prev_total = t;
+            } else if (cpu < ncpus) {
+                compute(prev[cpu], t, usage[cpu]);
+                prev[cpu] = t;
+                online[cpu] = 1;
+            }
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            if (!nl) break;
+            p = nl + 1;
+        }
+        return true;
+    }
+};
+
+// Cumulative counters from one line of /proc/diskstats; times are in ms.
+struct DiskCounters {
+    unsigned long long reads = 0, sectors_read = 0, read_ms = 0;
+    unsigned long long writes = 0, sectors_written = 0, write_ms = 0;
+    unsigned long long in_flight = 0, io_ms = 0, weighted_ms = 0;
+};
+
+// One block device over the last interval.
+struct DiskUsage {
+    char name[32] = {0};
+    double util_pct = 0.0;   // share of the interval with I/O in flight
+    double read_iops = 0.0;
+    double write_iops = 0.0;
+    double read_bps = 0.0;
+    double write_bps = 0.0;
+    double await_ms = 0.0;   // mean time per completed request, queueing included
+    double queue = 0.0;      // average number of requests in flight
+};
+
+// Whole-disk throughput from /proc/diskstats. Devices live in a fixed
+// open-addressed array keyed by major:minor and the file is read into a
+// buffer sized once (it only grows if the file outgrows it), so a steady-
+// state sample does not allocate. Partitions (no /sys/block/<name>) and
+// devices that never saw a request are left out of the panel.
+struct DiskStats {
+    static constexpr size_t SLOTS = 256; // power of two; at most half are used
+
+    struct Slot {
+        bool used = false;
+        bool whole = true;
+        unsigned major = 0, minor = 0;
+        unsigned gen = 0;
+        DiskCounters prev;
+        DiskUsage usage;
+    };
+
+    int fd = -1;
+    std::vector<char> buf;
+    std::array<Slot, SLOTS> slots{};
+    std::array<Slot, SLOTS> scratch{}; // for dropping removed devices
+    size_t count = 0;
+    unsigned gen = 0;
+    double last = 0.0; // time of the previous sample, seconds
+
+    DiskStats() {
+        buf.resize(16384);
+        fd = open(proc_path("diskstats").c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    ~DiskStats() {
+        if (fd >= 0) close(fd);
+    }
+
+    DiskStats(const DiskStats &) = delete;
+    DiskStats &operator=(const DiskStats &) = delete;
+
+    static size_t home(unsigned major, unsigned minor) { return ((major << 20 | minor) * 2654435761u) & (SLOTS - 1); }
+
+    Slot *find(unsigned major, unsigned minor, bool &inserted) {
+        inserted = false;
+        for (size_t i = home(major, minor);; i = (i + 1) & (SLOTS - 1)) {
+            Slot &s = slots[i];
+            if (s.used && s.major == major && s.minor == minor) return &s;
+            if (!s.used) {
+                if ((count + 1) * 2 > SLOTS) return nullptr; // ignore devices past the cap
+                s = Slot{};
+                s.used = true;
+                s.major = major;
+                s.minor = minor;
+                ++count;
+                inserted = true;
+                return &s;
+            }
+        }
+    }
+
+    // Whole disks have a /sys/block entry ('/' in names becomes '!');
+    // without sysfs every device counts as one.
+    static bool is_whole_disk(const char *name) {
+        char path[96];
+        int len = snprintf(path, sizeof(path), "/sys/block/%s", name);
+        for (int i = (int)sizeof("/sys/block/") - 1; i < len && i < (int)sizeof(path); ++i)
+            if (path[i] == '/') path[i] = '!';
+        return access(path, F_OK) == 0 || access("/sys/block", F_OK) != 0;
+    }
+
+    // Read the file and update each device's rates over the time since the
+    // previous call. `now` is in seconds (any fixed epoch).
+    bool sample(double now) {
+        if (fd < 0) return false;
+        ssize_t n;
+        while ((n = pread(fd, buf.data(), buf.size() - 1, 0)) >= (ssize_t)buf.size() - 1) buf.resize(buf.size() * 2);
+        if (n <= 0) return false;
+        const double elapsed_ms = last > 0.0 ? (now - last) * 1000.0 : 0.0;
+        last = now;
+        ++gen;
+
+        const char *p = buf.data();
+        const char *end = p + n;
+        while (p < end) {
+            const char *eol = (const char *)memchr(p, '\n', end - p);
+            if (!eol) eol = end;
+            // major minor name, then at least 11 counters
+            unsigned long long major, minor;
+            if (next_num(p, eol, major) && next_num(p, eol, minor)) {
+                while (p < eol && *p == ' ') ++p;
+                const char *name = p;
+                while (p < eol && *p != ' ') ++p;
+                size_t name_len = std::min<size_t>(p - name, sizeof(DiskUsage::name) - 1);
+                unsigned long long f[11] = {0};
+                int got = 0;
+                while (got < 11 && next_num(p, eol, f[got])) ++got;
+                bool inserted;
+                Slot *s = got == 11 ? find((unsigned)major, (unsigned)minor, inserted) : nullptr;
+                if (s) {
+                    DiskCounters c;
+                    c.reads = f[0]; c.sectors_read = f[2]; c.read_ms = f[3];
+                    c.writes = f[4]; c.sectors_written = f[6]; c.write_ms = f[7];
+                    c.in_flight = f[8]; c.io_ms = f[9]; c.weighted_ms = f[10];
+                    if (inserted) {
+                        memcpy(s->usage.name, name, name_len);
+                        s->usage.name[name_len] = '\0';
+                        s->whole = is_whole_disk(s->usage.name);
+                    } else if (elapsed_ms > 0.0) {
+                        compute(s->prev, c, elapsed_ms, s->usage);
+                    }
+                    s->prev = c;
+                    s->gen = gen;
+                }
+            }
+            p = eol + 1;
+        }
+        bool removed = false;
+        for (const Slot &s : slots) removed |= s.used && s.gen != gen;
+        if (removed) drop_unseen();
+        return true;
+    }
+
+    static void compute(const DiskCounters &a, const DiskCounters &b, double elapsed_ms, DiskUsage &u) {
+        auto d = [](unsigned long long x, unsigned long long y) { return y > x ? (double)(y - x) : 0.0; };
+        const double secs = elapsed_ms / 1000.0;
+        double ios = d(a.reads, b.reads) + d(a.writes, b.writes);
+        u.read_iops = d(a.reads, b.reads) / secs;
+        u.write_iops = d(a.writes, b.writes) / secs;
+        u.read_bps = d(a.sectors_read, b.sectors_read) * 512.0 / secs;
+        u.write_bps = d(a.sectors_written, b.sectors_written) * 512.0 / secs;
+        u.util_pct = std::min(100.0, d(a.io_ms, b.io_ms) * 100.0 / elapsed_ms);
+        u.await_ms = ios > 0.0 ? (d(a.read_ms, b.read_ms) + d(a.write_ms, b.write_ms)) / ios : 0.0;
+        u.queue = d(a.weighted_ms, b.weighted_ms) / elapsed_ms;
+    }
+
+    // Rebuild the table without the devices missing from the last read.
+    void drop_unseen() {
+        scratch = slots;
+        slots.fill(Slot{});
+        count = 0;
+        for (const Slot &o : scratch) {
+            if (!o.used || o.gen != gen) continue;
+            size_t i = home(o.major, o.minor);
+            while (slots[i].used) i = (i + 1) & (SLOTS - 1);
+            slots[i] = o;
+            ++count;
+        }
+    }
+
+    // Whole disks that have served any I/O, by name (slots are in hash order).
+    void collect(std::vector<DiskUsage> &out) const {
+        out.clear();
+        for (const Slot &s : slots) {
+            if (s.used && s.whole && s.prev.reads + s.prev.writes > 0) out.push_back(s.usage);
+        }
+        std::sort(out.begin(), out.end(), [](const DiskUsage &a, const DiskUsage &b) {
+            return strcmp(a.name, b.name) < 0;
+        });
+    }
+};
+
+// Cumulative counters of one interface from /proc/net/dev.
+struct NetCounters {
+    unsigned long long rx_bytes = 0, rx_packets = 0, rx_errs = 0, rx_drop = 0;
+    unsigned long long tx_bytes = 0, tx_packets = 0, tx_errs = 0, tx_drop = 0;
+};
+
+// One network interface over the last interval, per second.
+struct NetUsage {
+    char name[32] = {0};
+    double rx_bps = 0.0, rx_pps = 0.0, rx_errs = 0.0, rx_drop = 0.0;
+    double tx_bps = 0.0, tx_pps = 0.0, tx_errs = 0.0, tx_drop = 0.0;
+};
+
+// Per-interface throughput from /proc/net/dev (of our network namespace),
+// re-read through one descriptor with pread(). Interfaces are few, so they
+// sit in a vector looked up by name; ones that disappear are dropped, and
+// ones that never moved a byte are left out of the panel.
+struct NetStats {
+    struct Entry {
+        NetCounters prev;
+        NetUsage usage;
+        unsigned gen = 0;
+    };
+
+    int fd = -1;
+    std::vector<char> buf;
+    std::vector<Entry> entries;
+    unsigned gen = 0;
+    double last = 0.0; // time of the previous sample, seconds
+
+    NetStats() {
+        buf.resize(16384);
+        fd = open(proc_path("net/dev").c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    ~NetStats() {
+        if (fd >= 0) close(fd);
+    }
+
+    NetStats(const NetStats &) = delete;
+    NetStats &operator=(const NetStats &) = delete;
+
+    // `now` is in seconds (any fixed epoch).
+    bool sample(double now) {
+        if (fd < 0) return false;
+        ssize_t n;
+        while ((n = pread(fd, buf.data(), buf.size() - 1, 0)) >= (ssize_t)buf.size() - 1) buf.resize(buf.size() * 2);
+        if (n <= 0) return false;
+        const double secs = last > 0.0 ? now - last : 0.0;
+        last = now;
+        ++gen;
+
+        const char *p = buf.data();
+        const char *end = p + n;
+        while (p < end) {
+            const char *eol = (const char *)memchr(p, '\n', end - p);
+            if (!eol) eol = end;
+            // "  name: rx bytes packets errs drop fifo frame compressed multicast
+            //  tx bytes packets errs drop fifo colls carrier compressed";
+            // the two header lines have no ':' before a '|'
+            const char *colon = (const char *)memchr(p, ':', eol - p);
+            if (colon) {
+                while (p < colon && *p == ' ') ++p;
+                size_t name_len = std::min<size_t>(colon - p, sizeof(NetUsage::name) - 1);
+                const char *q = colon + 1;
+                unsigned long long f[16] = {0};
+                int got = 0;
+                while (got < 16 && next_num(q, eol, f[got])) ++got;
+                if (got == 16) {
+                    NetCounters c;
+                    c.rx_bytes = f[0]; c.rx_packets = f[1]; c.rx_errs = f[2]; c.rx_drop = f[3];
+                    c.tx_bytes = f[8]; c.tx_packets = f[9]; c.tx_errs = f[10]; c.tx_drop = f[11];
+                    update(p, name_len, c, secs);
+                }
+            }
+            p = eol + 1;
+        }
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [this](const Entry &e) { return e.gen != gen; }),
+                      entries.end());
+        return true;
+    }
+
+    void update(const char *name, size_t name_len, const NetCounters &c, double secs) {
+        Entry *e = nullptr;
+        for (Entry &x : entries) {
+            if (strlen(x.usage.name) == name_len && memcmp(x.usage.name, name, name_len) == 0) {
+                e = &x;
+                break;
+            }
+        }
+        if (!e) {
+            entries.emplace_back();
+            e = &entries.back();
+            memcpy(e->usage.name, name, name_len);
+            e->usage.name[name_len] = '\0';
+        } else if (secs > 0.0) {
+            // counters can go back when a driver resets them; count that as 0
+            auto rate = [secs](unsigned long long a, unsigned long long b) { return b > a ? (double)(b - a) / secs : 0.0; };
+            const NetCounters &a = e->prev;
+            NetUsage &u = e->usage;
+            u.rx_bps = rate(a.rx_bytes, c.rx_bytes);
+            u.rx_pps = rate(a.rx_packets, c.rx_packets);
+            u.rx_errs = rate(a.rx_errs, c.rx_errs);
+            u.rx_drop = rate(a.rx_drop, c.rx_drop);
+            u.tx_bps = rate(a.tx_bytes, c.tx_bytes);
+            u.tx_pps = rate(a.tx_packets, c.tx_packets);
+            u.tx_errs = rate(a.tx_errs, c.tx_errs);
+            u.tx_drop = rate(a.tx_drop, c.tx_drop);
+        }
+        e->prev = c;
+        e->gen = gen;
+    }
+
+    // Interfaces that have carried any traffic, in file order.
+    void collect(std::vector<NetUsage> &out) const {
+        out.clear();
+        for (const Entry &e : entries) {
+            if (e.prev.rx_bytes + e.prev.tx_bytes > 0) out.push_back(e.usage);
+        }
+    }
+};
+
+// Fill prev_time from the previous-sample table and compute CPU%, MEM% and
+// I/O rates for every row of the table.
+// `now` is the sample time in seconds (any fixed epoch).
+void compute_deltas(ProcTable &procs, PrevTimeTable &prev_proc_time, double now, double mem_total_mb) {
+    const size_t nprocs = procs.size();
+    // CPU percent = (proc_time_delta / time_hz) / seconds_since_last_read * 100
+    // memory percent = rss_bytes / total_bytes * 100
+    const double cpu_scale = 100.0 / procs.time_hz;
+    const double mem_scale = (mem_total_mb > 0.0) ? ((double)PAGE_SIZE / (1024.0 * 1024.0)) / mem_total_mb * 100.0 : 0.0;
+    const unsigned long long *time = procs.time.data();
+    unsigned long long *prev_time = procs.prev_time.data();
+    const long *rss_pages = procs.rss_pages.data();
+    double *cpu = procs.cpu_pct.data();
+    double *mem = procs.mem_pct.data();
+    const IoCounters *io = procs.io.data();
+    const uint8_t *io_ok = procs.io_ok.data();
+    IoRates *io_rate = procs.io_rate.data();
+    auto rate = [](unsigned long long cur, unsigned long long prev, double span) {
+        return cur > prev ? (double)(cur - prev) / span : 0.0;
+    };
+    prev_proc_time.begin_tick();
+    for (size_t i = 0; i < nprocs; ++i) {
+        bool inserted;
+        PrevTimeTable::Slot &s = prev_proc_time.touch(procs.pid[i], inserted);
+        if (!inserted && procs.stale[i]) {
+            // not re-read this tick: keep the last rate
+            prev_time[i] = s.time;
+            cpu[i] = s.cpu_pct;
+            io_rate[i] = s.io_rate;
+        } else {
+            prev_time[i] = inserted ? time[i] : s.time;
+            double span = now - s.stamp;
+            unsigned long long delta = (time[i] > prev_time[i]) ? (time[i] - prev_time[i]) : 0ULL;
+            cpu[i] = (!inserted && span > 0.0) ? (double)delta * cpu_scale / span : 0.0;
+            io_rate[i] = IoRates{};
+            if (!inserted && span > 0.0 && io_ok[i] && s.io_ok) {
+                io_rate[i].read_bps = rate(io[i].read_bytes, s.io.read_bytes, span);
+                io_rate[i].write_bps = rate(io[i].write_bytes, s.io.write_bytes, span);
+                io_rate[i].syscr = rate(io[i].syscr, s.io.syscr, span);
+                io_rate[i].syscw = rate(io[i].syscw, s.io.syscw, span);
+            }
+            s.time = time[i];
+            s.stamp = now;
+            s.cpu_pct = cpu[i];
+            s.io_ok = io_ok[i];
+            s.io = io[i];
+            s.io_rate = io_rate[i];
+        }
+        mem[i] = (double)rss_pages[i] * mem_scale;
+    }
+    prev_proc_time.end_tick(); // forget PIDs that have exited
+}
+
+// Process tree in pre-order with subtree totals, one entry per position.
+struct TreeLayout {
+    std::vector<uint32_t> rows;  // process table row
+    std::vector<uint16_t> depth; // 0 for roots
+    std::vector<double> cpu_pct; // the process plus all its descendants
+    std::vector<double> mem_pct;
+    void clear() {
+        rows.clear();
+        depth.clear();
+        cpu_pct.clear();
+        mem_pct.clear();
+    }
+};
+
+// Parent -> children index over PIDs, kept between ticks as intrusive
+// sibling lists. update() only relinks processes that appeared, exited or
+// changed parent; PID 0 is the virtual root holding every process whose
+// parent is not in the table (init, kthreadd, container roots). The index is
+// only maintained while the tree view is shown: reset() drops it when the
+// view is turned off and the next update() rebuilds it from scratch.
+struct ProcTree {
+    struct Node {
+        int parent = 0; // PID linked under, 0 = root
+        int first_child = 0, last_child = 0;
+        int prev = 0, next = 0; // siblings
+        unsigned gen = 0;
+        uint32_t row = 0; // table row this tick
+        uint32_t pos = 0; // scratch: position in the last flatten()
+    };
+
+    std::unordered_map<int, Node> nodes{{0, Node{}}};
+    unsigned gen = 0;
+    std::vector<int> exited; // scratch
+
+    void unlink(Node &n) {
+        Node &p = nodes[n.parent];
+        if (n.prev) nodes[n.prev].next = n.next;
+        else p.first_child = n.next;
+        if (n.next) nodes[n.next].prev = n.prev;
+        else p.last_child = n.prev;
+        n.prev = n.next = 0;
+    }
+
+    void reset() {
+        if (nodes.size() == 1) return;
+        nodes.clear();
+        nodes.emplace(0, Node{});
+    }
+
+    void link(int pid, Node &n, int parent) {
+        Node &p = nodes[parent];
+        n.parent = parent;
+        n.prev = p.last_child;
+        n.next = 0;
+        if (p.last_child) nodes[p.last_child].next = pid;
+        else p.first_child = pid;
+        p.last_child = pid;
+    }
+
+    void update(const ProcTable &procs) {
+        ++gen;
+        // new PIDs start out under the root
+        for (size_t i = 0; i < procs.size(); ++i) {
+            auto ins = nodes.try_emplace(procs.pid[i]);
+            Node &n = ins.first->second;
+            if (ins.second) link(procs.pid[i], n, 0);
+            n.gen = gen;
+            n.row = (uint32_t)i;
+        }
+        // exited PIDs: unlink, and move their children to the root until
+        // they show up with their new parent
+        exited.clear();
+        for (auto &kv : nodes) {
+            if (kv.first != 0 && kv.second.gen != gen) exited.push_back(kv.first);
+        }
+        for (int pid : exited) {
+            Node &n = nodes[pid];
+            unlink(n);
+            for (int c = n.first_child; c;) {
+                Node &cn = nodes[c];
+                int next = cn.next;
+                link(c, cn, 0);
+                c = next;
+            }
+            nodes.erase(pid);
+        }
+        // relink where the parent changed, or first became known
+        for (size_t i = 0; i < procs.size(); ++i) {
+            int pid = procs.pid[i];
+            int parent = procs.ppid[i];
+            if (parent == pid || !nodes.count(parent)) parent = 0;
+            Node &n = nodes[pid];
+            if (n.parent == parent) continue;
+            unlink(n);
+            link(pid, n, parent);
+        }
+    }
+
+    // Pre-order walk from the root, then one reverse pass over the flat
+    // array to sum each subtree into its parent (children always follow
+    // their parent, so reverse pre-order visits them first).
+    void flatten(const ProcTable &procs, TreeLayout &out) {
+        out.clear();
+        std::vector<int32_t> parent_pos;
+        int depth = 0;
+        int cur = nodes[0].first_child;
+        while (cur) {
+            Node &n = nodes[cur];
+            n.pos = (uint32_t)out.rows.size();
+            out.rows.push_back(n.row);
+            out.depth.push_back((uint16_t)std::min(depth, 65535));
+            out.cpu_pct.push_back(procs.cpu_pct[n.row]);
+            out.mem_pct.push_back(procs.mem_pct[n.row]);
+            parent_pos.push_back(n.parent ? (int32_t)nodes[n.parent].pos : -1);
+            if (n.first_child) {
+                cur = n.first_child;
+                ++depth;
+                continue;
+            }
+            // climb until a node with a next sibling; stop at the root
+            while (cur && !nodes[cur].next) {
+                cur = nodes[cur].parent;
+                --depth;
+            }
+            if (cur) cur = nodes[cur].next;
+        }
+        for (size_t p = out.rows.size(); p-- > 0;) {
+            if (parent_pos[p] < 0) continue;
+            out.cpu_pct[parent_pos[p]] += out.cpu_pct[p];
+            out.mem_pct[parent_pos[p]] += out.mem_pct[p];
+        }
+    }
+};
+
+// Totals of one cgroup v2 group, for the grouped view.
+struct CgroupRow {
+    std::string path; // relative to cgroup_root
+    uint32_t nprocs = 0;
     double cpu_pct = 0.0;
     double mem_pct = 0.0;
+    unsigned long long mem_bytes = 0; // memory.current
+    unsigned long long anon_bytes = 0, file_bytes = 0;
+    double read_bps = 0.0, write_bps = 0.0;
 };
 
-static long CLK_TCK = sysconf(_SC_CLK_TCK);
-static long PAGE_SIZE = sysconf(_SC_PAGESIZE);
+// Reads the cgroups that hold at least one listed process straight from
+// their controller files (cpu.stat, memory.current, memory.stat, io.stat)
+// through cached descriptors, instead of summing per-PID rows. Groups whose
+// processes are all gone are dropped along with their descriptors.
+struct CgroupTable {
+    struct Group {
+        int cpu_fd = -1, mem_fd = -1, memstat_fd = -1, io_fd = -1;
+        unsigned gen = 0;
+        double stamp = 0.0; // when the counters below were read, in seconds
+        unsigned long long usage_usec = 0, rbytes = 0, wbytes = 0;
+    };
 
-unsigned long long read_total_time_from_proc_stat() {
-    std::ifstream f("/proc/stat");
-    std::string line;
-    if (!std::getline(f, line)) return 0;
-    std::istringstream iss(line);
-    std::string cpu;
-    unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
-    user = nice = system = idle = iowait = irq = softirq = steal = 0;
-    iss >> cpu >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal;
-    return user + nice + system + idle + iowait + irq + softirq + steal;
+    std::unordered_map<std::string, Group> groups;
+    unsigned gen = 0;
+    std::vector<uint32_t> counts; // scratch: processes per cgroup id
+
+    ~CgroupTable() {
+        for (auto &kv : groups) close_group(kv.second);
+    }
+
+    static void close_group(Group &g) {
+        for (int fd : {g.cpu_fd, g.mem_fd, g.memstat_fd, g.io_fd}) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    static int open_file(const std::string &dir, const char *leaf) {
+        return open((dir + "/" + leaf).c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    static ssize_t read_fd(int fd, char *buf, size_t cap) {
+        if (fd < 0) return -1;
+        ssize_t n = pread(fd, buf, cap - 1, 0);
+        if (n >= 0) buf[n] = '\0';
+        return n;
+    }
+
+    // Value of `key` in a "key value" per line file such as cpu.stat.
+    static unsigned long long keyed_value(const char *buf, ssize_t n, const char *key) {
+        size_t klen = strlen(key);
+        for (const char *line = buf; n > 0 && line < buf + n;) {
+            const char *eol = (const char *)memchr(line, '\n', buf + n - line);
+            if (!eol) eol = buf + n;
+            if ((size_t)(eol - line) > klen && memcmp(line, key, klen) == 0 && line[klen] == ' ') {
+                const char *c = line + klen;
+                unsigned long long v = 0;
+                return next_num(c, eol, v) ? v : 0;
+            }
+            line = eol + 1;
+        }
+        return 0;
+    }
+
+    void sample(const ProcTable &procs, double now, double mem_total_mb, std::vector<CgroupRow> &out) {
+        ++gen;
+        counts.assign(procs.cgroups.size(), 0);
+        for (size_t i = 0; i < procs.size(); ++i) {
+            if (procs.cgroup_id[i] < counts.size()) ++counts[procs.cgroup_id[i]];
+        }
+        const double mem_total = mem_total_mb * 1024.0 * 1024.0;
+        char buf[8192];
+        size_t n_out = 0;
+        for (uint32_t id = 0; id < counts.size(); ++id) {
+            const std::string &path = procs.cgroups[id];
+            if (counts[id] == 0 || path.empty()) continue; // unmapped (e.g. cgroup v1 only)
+            auto ins = groups.try_emplace(path);
+            Group &g = ins.first->second;
+            if (ins.second) {
+                std::string dir = cgroup_root + path;
+                g.cpu_fd = open_file(dir, "cpu.stat");
+                g.mem_fd = open_file(dir, "memory.current");
+                g.memstat_fd = open_file(dir, "memory.stat");
+                g.io_fd = open_file(dir, "io.stat");
+            }
+            g.gen = gen;
+
+            if (n_out == out.size()) out.emplace_back();
+            CgroupRow &r = out[n_out++];
+            r.path = path;
+            r.nprocs = counts[id];
+            ssize_t n = read_fd(g.cpu_fd, buf, sizeof(buf));
+            unsigned long long usage = keyed_value(buf, n, "usage_usec");
+            n = read_fd(g.mem_fd, buf, sizeof(buf));
+            const char *c = buf;
+            r.mem_bytes = 0;
+            if (n > 0) next_num(c, buf + n, r.mem_bytes);
+            n = read_fd(g.memstat_fd, buf, sizeof(buf));
+            r.anon_bytes = keyed_value(buf, n, "anon");
+            r.file_bytes = keyed_value(buf, n, "file");
+            // io.stat: "MAJ:MIN rbytes=N wbytes=N rios=N ..." per device
+            unsigned long long rbytes = 0, wbytes = 0;
+            n = read_fd(g.io_fd, buf, sizeof(buf));
+            for (const char *p = buf; n > 0 && (p = strstr(p, "bytes=")) != nullptr; p += 6) {
+                const char *v = p + 6;
+                unsigned long long x = 0;
+                next_num(v, buf + n, x);
+                if (p > buf && p[-1] == 'r') rbytes += x;
+                else if (p > buf && p[-1] == 'w') wbytes += x;
+            }
+
+            // rates over the time since this group was last read
+            double span = now - g.stamp;
+            bool have_prev = !ins.second && span > 0.0;
+            r.cpu_pct = (have_prev && usage >= g.usage_usec) ? (double)(usage - g.usage_usec) / 1e6 / span * 100.0 : 0.0;
+            r.read_bps = (have_prev && rbytes >= g.rbytes) ? (double)(rbytes - g.rbytes) / span : 0.0;
+            r.write_bps = (have_prev && wbytes >= g.wbytes) ? (double)(wbytes - g.wbytes) / span : 0.0;
+            r.mem_pct = mem_total > 0.0 ? (double)r.mem_bytes / mem_total * 100.0 : 0.0;
+            g.usage_usec = usage;
+            g.rbytes = rbytes;
+            g.wbytes = wbytes;
+            g.stamp = now;
+        }
+        out.resize(n_out);
+        for (auto it = groups.begin(); it != groups.end();) {
+            if (it->second.gen != gen) {
+                close_group(it->second);
+                it = groups.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+// Set by the UI while the tree view is shown; the collector only flattens
+// the tree then.
+static std::atomic<bool> tree_view{false};
+
+// Fixed-cadence ticks on CLOCK_MONOTONIC. Deadline k is start + k * interval,
+// so the time spent sampling never shifts the schedule. A tick that runs past
+// later deadlines skips them rather than firing them back to back.
+struct TickTimer {
+    int fd = -1; // periodic timerfd; -1 falls back to clock_nanosleep
+    int64_t interval_ns;
+    int64_t start_ns;
+    uint64_t ticks = 0; // deadlines consumed so far
+
+    static int64_t monotonic_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    static timespec to_timespec(int64_t ns) {
+        timespec ts;
+        ts.tv_sec = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        return ts;
+    }
+
+    explicit TickTimer(milliseconds iv)
+        : interval_ns(duration_cast<nanoseconds>(iv).count()), start_ns(monotonic_ns()) {
+        fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd < 0) return;
+        itimerspec its{};
+        its.it_interval = to_timespec(interval_ns);
+        its.it_value = to_timespec(start_ns + interval_ns);
+        if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, nullptr) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    ~TickTimer() {
+        if (fd >= 0) close(fd);
+    }
+
+    TickTimer(const TickTimer &) = delete;
+    TickTimer &operator=(const TickTimer &) = delete;
+
+    // Block until the next deadline. Returns false without consuming a tick
+    // when `wake_fd` (-1 for none) becomes readable or a signal arrives.
+    bool wait(int wake_fd) {
+        uint64_t expired = 0;
+        if (fd >= 0) {
+            pollfd fds[2] = {{fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+            if (poll(fds, 2, -1) <= 0 || (fds[1].revents & POLLIN)) return false;
+            if (read(fd, &expired, sizeof(expired)) != (ssize_t)sizeof(expired)) return false;
+        } else {
+            timespec next = to_timespec(start_ns + (int64_t)(ticks + 1) * interval_ns);
+            if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) != 0) return false;
+            expired = std::max<uint64_t>(1, (uint64_t)((monotonic_ns() - start_ns) / interval_ns) - ticks);
+        }
+        ticks += expired;
+        if (expired > 1) ticks_skipped.fetch_add(expired - 1, std::memory_order_relaxed);
+        int64_t late = monotonic_ns() - (start_ns + (int64_t)ticks * interval_ns);
+        phase_hist[PH_LATE].record((uint64_t)std::max<int64_t>(0, late));
+        return true;
+    }
+};
+
+// Everything the UI and batch mode need from one sample. Filled by
+// Sampler::sample() and read-only once published.
+struct Snapshot {
+    ProcTable procs;
+    int threads_pid = 0; // process the thread table belongs to, 0 = none
+    ProcTable threads;
+    bool acct = false; // procs.acct filled (taskstats backend)
+    ProcViews views;   // which view-only columns of procs this sample filled
+    TreeLayout tree; // filled only while the tree view is on
+    std::vector<CgroupRow> cgroups; // filled only while the cgroup view is on
+    double interval = 1.0; // seconds since the previous sample
+    double uptime = 0.0;
+    double mem_total_mb = 0.0;
+    double mem_free_mb = 0.0;
+    double mem_avail_mb = 0.0;
+    MemInfo mem; // all of /proc/meminfo
+    int ncpus = 0;
+    CpuUsage cpu_total;
+    std::vector<CpuUsage> cpu_usage; // per core
+    std::vector<char> cpu_online;
+    std::vector<DiskUsage> disks; // whole disks with any I/O so far
+    std::vector<NetUsage> nets;   // interfaces with any traffic so far
+};
+
+// One collection pass: system totals, memory and the process table with
+// per-process CPU/MEM percentages. Shared by the collector thread and batch
+// mode; keeps the previous-sample state between calls.
+struct Sampler {
+    PrevTimeTable prev_proc_time{read_pid_max()}; // pid -> previous CPU time
+    PrevTimeTable prev_thread_time{read_pid_max()}; // tid -> previous CPU time, thread view
+    ProcTree tree;
+    CgroupTable cgroups;
+    MemInfoReader meminfo;
+    CpuStat cpu;
+    DiskStats disks;
+    NetStats nets;
+    steady_clock::time_point last_time = steady_clock::now();
+
+    void sample(Snapshot &out) {
+        // sample times
+        auto now = steady_clock::now();
+        out.interval = duration_cast<duration<double>>(now - last_time).count();
+        if (out.interval <= 0.0) out.interval = 1.0; // fallback
+        last_time = now;
+        double now_s = duration_cast<duration<double>>(now.time_since_epoch()).count();
+
+        {
+            PhaseTimer timer(PH_SYSTEM);
+            cpu.sample();
+            out.ncpus = cpu.ncpus;
+            out.cpu_total = cpu.total;
+            out.cpu_usage = cpu.usage;
+            out.cpu_online = cpu.online;
+            out.uptime = get_uptime_seconds();
+            meminfo.read(out.mem);
+            out.mem_total_mb = out.mem.mb(MI_MemTotal);
+            out.mem_free_mb = out.mem.mb(MI_MemFree);
+            out.mem_avail_mb = out.mem.mb(MI_MemAvailable);
+            disks.sample(now_s);
+            disks.collect(out.disks);
+            nets.sample(now_s);
+            nets.collect(out.nets);
+        }
+
+        // Read processes; the view flags are read once so the mapping, the
+        // group totals and the snapshot agree even if the UI flips them
+        out.views.cgroups = cgroup_view.load(std::memory_order_relaxed);
+        out.views.sockets = socket_view.load(std::memory_order_relaxed);
+        out.views.smaps = smaps_view.load(std::memory_order_relaxed);
+        get_all_processes(out.procs, out.views);
+        out.acct = taskstats.active();
+
+        // threads of the expanded process, if any
+        out.threads_pid = std::max(0, expanded_pid.load(std::memory_order_relaxed));
+        get_threads(out.threads_pid, out.threads);
+
+        // Compute per-process (and per-thread) deltas and percentages
+        PhaseTimer timer(PH_DELTA);
+        compute_deltas(out.procs, prev_proc_time, now_s, out.mem_total_mb);
+        compute_deltas(out.threads, prev_thread_time, now_s, out.mem_total_mb);
+        if (tree_view.load(std::memory_order_relaxed)) {
+            tree.update(out.procs);
+            tree.flatten(out.procs, out.tree);
+        } else {
+            tree.reset();
+            out.tree.clear();
+        }
+        if (out.views.cgroups) cgroups.sample(out.procs, now_s, out.mem_total_mb, out.cgroups);
+        else out.cgroups.clear();
+    }
+};
+
+// Lock-free triple buffer of snapshots between the collector thread and the
+// UI. The writer fills `back` and swaps it into `middle`, flagged fresh; the
+// reader swaps a fresh `middle` for its `front`. Neither side ever waits for
+// the other, and a snapshot the reader holds is never written to.
+struct SnapshotBuffer {
+    static constexpr unsigned FRESH = 4;
+    Snapshot slots[3];
+    std::atomic<unsigned> middle{1};
+    unsigned back = 0;  // owned by the writer
+    unsigned front = 2; // owned by the reader
+
+    Snapshot &write_slot() { return slots[back]; }
+
+    void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3; }
+
+    // Swap in the newest snapshot; returns false if nothing new was published.
+    bool acquire() {
+        if (!(middle.load(std::memory_order_acquire) & FRESH)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    const Snapshot &read_slot() const { return slots[front]; }
+};
+
+// Background thread that samples on a TickTimer and publishes through a
+// SnapshotBuffer, so input handling and slow terminals never delay a
+// sample. Owns all collection state (handle cache, scan pool, netlink
+// sockets are only touched from this thread while it runs). `ready_fd`
+// becomes readable after each publish so the UI can poll() on it.
+struct Collector {
+    SnapshotBuffer buffer;
+    milliseconds interval;
+    int ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    std::atomic<bool> stop{false};
+    std::thread thread;
+
+    explicit Collector(milliseconds iv) : interval(iv) {
+        thread = std::thread([this] { run(); });
+    }
+
+    ~Collector() {
+        stop = true;
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) < 0) {} // wakes TickTimer::wait
+        thread.join();
+        close(stop_fd);
+        close(ready_fd);
+    }
+
+    // Clear the ready flag after picking up a snapshot.
+    void consume_ready() {
+        uint64_t v;
+        if (read(ready_fd, &v, sizeof(v)) < 0) {} // EAGAIN when already clear
+    }
+
+    void run() {
+        Sampler sampler;
+        TickTimer timer(interval);
+        while (true) {
+            auto tick_start = steady_clock::now();
+            sampler.sample(buffer.write_slot());
+            buffer.publish();
+            uint64_t one = 1;
+            if (write(ready_fd, &one, sizeof(one)) < 0) {} // counter saturation is harmless
+            // signals interrupt the wait too; only a stop request ends the loop
+            while (!timer.wait(stop_fd))
+                if (stop) return;
+            record_phase(PH_TICK, tick_start);
+        }
+    }
+};
+
+// Batch mode writes a stream of snapshots, each preceded by its length in
+// bytes as a u32. Integers and doubles are in host byte order.
+//   snapshot := "SMS1" | u32 version | u32 flags | u64 unix_time_ns
+//               | f64 interval_s | f64 uptime_s | f64 mem_total_mb
+//               | f64 mem_free_mb | f64 mem_avail_mb | u32 nprocs
+//               | nprocs * process
+//   process  := i32 pid | u64 time (clock ticks) | i64 rss_pages
+//               | f64 cpu_pct | f64 mem_pct | u16 name_len | name bytes
+//               [ | acct ]
+//   acct     := u64 cpu_delay_ns | u64 blkio_delay_ns | u64 swapin_delay_ns
+//               | u64 hiwater_rss_kb | u64 hiwater_vm_kb
+// acct (cumulative, from taskstats) is present when flags has SNAP_ACCT.
+static const uint32_t SNAPSHOT_VERSION = 2;
+static const uint32_t SNAP_ACCT = 1;
+
+struct BatchOptions {
+    std::string output;     // empty = stdout
+    int interval_ms = 1000;
+    long count = 0;         // snapshots to write; 0 = until interrupted
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) { stop_requested = 1; }
+
+template <typename T>
+static void put_raw(std::vector<char> &out, T v) {
+    const char *p = (const char *)&v;
+    out.insert(out.end(), p, p + sizeof(T));
 }
 
-double get_uptime_seconds() {
-    std::ifstream f("/proc/uptime");
-    double up = 0;
-    f >> up;
-    return up;
+void encode_snapshot(const Snapshot &s, std::vector<char> &out) {
+    const ProcTable &procs = s.procs;
+    out.clear();
+    put_raw<uint32_t>(out, 0); // length, patched below
+    out.insert(out.end(), {'S', 'M', 'S', '1'});
+    put_raw<uint32_t>(out, SNAPSHOT_VERSION);
+    put_raw<uint32_t>(out, s.acct ? SNAP_ACCT : 0);
+    put_raw<uint64_t>(out, (uint64_t)duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+    put_raw<double>(out, s.interval);
+    put_raw<double>(out, s.uptime);
+    put_raw<double>(out, s.mem_total_mb);
+    put_raw<double>(out, s.mem_free_mb);
+    put_raw<double>(out, s.mem_avail_mb);
+    put_raw<uint32_t>(out, (uint32_t)procs.size());
+    for (size_t i = 0; i < procs.size(); ++i) {
+        const std::string &name = procs.names[procs.name_id[i]];
+        uint16_t name_len = (uint16_t)std::min<size_t>(name.size(), 0xffff);
+        put_raw<int32_t>(out, procs.pid[i]);
+        put_raw<uint64_t>(out, (uint64_t)((double)procs.time[i] * (double)CLK_TCK / procs.time_hz));
+        put_raw<int64_t>(out, procs.rss_pages[i]);
+        put_raw<double>(out, procs.cpu_pct[i]);
+        put_raw<double>(out, procs.mem_pct[i]);
+        put_raw<uint16_t>(out, name_len);
+        out.insert(out.end(), name.data(), name.data() + name_len);
+        if (s.acct) {
+            const TaskAcct &a = procs.acct[i];
+            put_raw<uint64_t>(out, a.cpu_delay_ns);
+            put_raw<uint64_t>(out, a.blkio_delay_ns);
+            put_raw<uint64_t>(out, a.swapin_delay_ns);
+            put_raw<uint64_t>(out, a.hiwater_rss_kb);
+            put_raw<uint64_t>(out, a.hiwater_vm_kb);
+        }
+    }
+    uint32_t len = (uint32_t)(out.size() - sizeof(uint32_t));
+    memcpy(out.data(), &len, sizeof(len));
 }
 
-void read_mem_info(double &total_mb, double &free_mb, double &avail_mb) {
-    std::ifstream f("/proc/meminfo");
-    std::string key;
-    unsigned long value;
-    std::string unit;
-    total_mb = free_mb = avail_mb = 0.0;
-    while (f >> key >> value >> unit) {
-        if (key == "MemTotal:") total_mb = value / 1024.0;
-        else if (key == "MemFree:") free_mb = value / 1024.0;
-        else if (key == "MemAvailable:") avail_mb = value / 1024.0;
+// Headless loop: sample at a fixed interval and write snapshots until
+// interrupted or `count` snapshots have been written.
+int run_batch(const BatchOptions &opt) {
+    FILE *out = stdout;
+    if (!opt.output.empty()) {
+        out = fopen(opt.output.c_str(), "wb");
+        if (!out) {
+            std::cerr << "cannot open " << opt.output << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+    }
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    Sampler sampler;
+    Snapshot snap;
+    std::vector<char> buf;
+    TickTimer timer(milliseconds(opt.interval_ms));
+    // a discarded sample fills the per-PID previous values, so the first
+    // snapshot written has a full interval of deltas for every process
+    sampler.sample(snap);
+    int rc = 0;
+    for (long n = 0; !stop_requested && (opt.count == 0 || n < opt.count); ++n) {
+        while (!timer.wait(-1) && !stop_requested) {}
+        if (stop_requested) break;
+        sampler.sample(snap);
+        encode_snapshot(snap, buf);
+        if (fwrite(buf.data(), 1, buf.size(), out) != buf.size() || fflush(out) != 0) {
+            rc = 1; // reader went away or disk full
+            break;
+        }
     }
+    if (out != stdout) fclose(out);
+    return rc;
 }
 
-std::string read_first_line(const std::string &path) {
-    std::ifstream f(path);
-    std::string s;
-    if (std::getline(f, s)) return s;
-    return "";
+// Text last drawn into each cell of the screen. Cells are numbered per line
+// by the caller. put() skips cells whose text is unchanged, and since the
+// screen is never clear()ed between frames, ncurses only emits the cells
+// that really changed.
+struct Frame {
+    std::vector<std::vector<std::string>> cells; // [y][cell]
+    int rows = 0;
+    int cols = 0;
+
+    // Forget everything drawn so far; the next frame repaints every cell.
+    void reset(int r, int c) {
+        cells.assign(std::max(0, r), {});
+        rows = r;
+        cols = c;
+    }
+
+    // Record `key` for cell idx of line y. Returns true if it differs from
+    // what was drawn there last frame.
+    bool update(int y, size_t idx, const char *key) {
+        if (y < 0 || y >= rows) return false;
+        auto &line = cells[y];
+        if (line.size() <= idx) line.resize(idx + 1);
+        if (line[idx] == key) return false;
+        line[idx] = key;
+        return true;
+    }
+
+    // Draw text left-aligned in a field of `width` columns (width < 0: to the
+    // end of the line), padding with blanks to wipe the previous contents.
+    void put(int y, int x, size_t idx, int width, const char *text) {
+        if (x >= cols || !update(y, idx, text)) return;
+        if (width < 0 || width > cols - x) width = cols - x;
+        mvprintw(y, x, "%-*.*s", width, width, text);
+    }
+};
+
+// Sets of four right-hand columns of the process table.
+enum ExtraColumns { XC_IO, XC_SOCKETS, XC_MEMORY };
+
+// Draw rows order[first, last) of the process table cell by cell from line
+// y, then blank the lines left over from a longer table up to y_end.
+// Display rows with THREAD_ROW set index the thread table instead of procs.
+// With a tree layout, the other rows are positions in it rather than table
+// rows, and show subtree totals with the name indented by depth.
+static const uint32_t THREAD_ROW = 1u << 31;
+
+// columns_filled is false when the socket or memory columns were not
+// collected for this table; they then show '-' like unreadable values.
+void draw_table(Frame &frame, const ProcTable &procs, const ProcTable &threads, const TreeLayout *tree, int columns,
+                bool columns_filled, const std::vector<uint32_t> &rows, size_t first, size_t last, int y, int y_end) {
+    // same layout as "%-6d %-20s %8.2f %8.2f %9.0f %9.0f %7.0f %7.0f"
+    static const int col_x[8] = {0, 7, 28, 37, 46, 56, 66, 74};
+    static const int col_w[8] = {7, 21, 9, 9, 10, 10, 8, -1};
+    char cell[64];
+    // indent of the process above the first row, for threads cut off at the top
+    int depth = 0;
+    for (size_t r = first; tree && r-- > 0;) {
+        if (!(rows[r] & THREAD_ROW)) {
+            depth = tree->depth[rows[r]];
+            break;
+        }
+    }
+    for (size_t r = first; r < last; ++r, ++y) {
+        bool is_thread = rows[r] & THREAD_ROW;
+        const ProcTable &t = is_thread ? threads : procs;
+        uint32_t i = rows[r] & ~THREAD_ROW;
+        double cpu_pct = t.cpu_pct[i];
+        double mem_pct = t.mem_pct[i];
+        if (tree && !is_thread) {
+            uint32_t p = i;
+            i = tree->rows[p];
+            depth = tree->depth[p];
+            cpu_pct = tree->cpu_pct[p];
+            mem_pct = tree->mem_pct[p];
+        }
+        // sanitize name length; tree levels and threads are indented
+        const std::string &pname = t.names[t.name_id[i]];
+        std::string name = pname.empty() ? "[" + std::to_string(t.pid[i]) + "]" : pname;
+        int indent = (tree ? std::min(depth, 6) : 0) + (is_thread ? 1 : 0);
+        if (indent) name = std::string(2 * indent, ' ') + name;
+        if ((int)name.size() > 20) name = name.substr(0, 17) + "...";
+
+        snprintf(cell, sizeof(cell), "%-6d", t.pid[i]);
+        frame.put(y, col_x[0], 0, col_w[0], cell);
+        frame.put(y, col_x[1], 1, col_w[1], name.c_str());
+        // '~' marks values carried over from an earlier tick
+        snprintf(cell, sizeof(cell), "%8.2f%s", cpu_pct, t.stale[i] ? "~" : "");
+        frame.put(y, col_x[2], 2, col_w[2], cell);
+        if (is_thread) snprintf(cell, sizeof(cell), "%8s", "-"); // memory is per process
+        else snprintf(cell, sizeof(cell), "%8.2f", mem_pct);
+        frame.put(y, col_x[3], 3, col_w[3], cell);
+        // right-hand columns for the process itself (also in the tree):
+        // disk I/O rates, sockets or memory detail; '-' where the source is
+        // not readable, and for threads where it is per process
+        static const char *const fmt[3][4] = {{"%9.0f", "%9.0f", "%7.0f", "%7.0f"},
+                                              {"%9.0f", "%9.0f", "%7.0f", "%7.0f"},
+                                              {"%9.1f", "%9.1f", "%7.1f", "%7.1f"}};
+        double v[4] = {0, 0, 0, 0};
+        bool known = false;
+        if (columns == XC_SOCKETS) {
+            const SockSummary &sk = t.socks[i];
+            known = columns_filled && !is_thread && sk.ok;
+            v[0] = sk.tcp;
+            v[1] = sk.udp;
+            v[2] = sk.rx_queue / 1024.0;
+            v[3] = sk.tx_queue / 1024.0;
+        } else if (columns == XC_MEMORY) {
+            const MemDetail &md = t.smaps[i];
+            known = columns_filled && !is_thread && md.ok;
+            v[0] = md.pss_kb / 1024.0;
+            v[1] = md.uss_kb / 1024.0;
+            v[2] = md.shared_kb / 1024.0;
+            v[3] = md.swap_kb / 1024.0;
+        } else {
+            const IoRates &io = t.io_rate[i];
+            known = t.io_ok[i];
+            v[0] = io.read_bps / 1024.0;
+            v[1] = io.write_bps / 1024.0;
+            v[2] = io.syscr;
+            v[3] = io.syscw;
+        }
+        for (size_t c = 0; c < 4; ++c) {
+            if (known) snprintf(cell, sizeof(cell), fmt[columns][c], v[c]);
+            else snprintf(cell, sizeof(cell), c < 2 ? "%9s" : "%7s", "-");
+            frame.put(y, col_x[4 + c], 4 + c, col_w[4 + c], cell);
+        }
+    }
+    for (; y < y_end; ++y) {
+        for (size_t c = 0; c < 8; ++c) frame.put(y, col_x[c], c, col_w[c], "");
+    }
 }
 
-bool is_digits(const char* s) {
-    if (!s || !*s) return false;
-    while (*s) {
-        if (!isdigit(*s)) return false;
-        ++s;
+// Grouped view: one row per cgroup, `rows` indexing `groups`.
+void draw_cgroups(Frame &frame, const std::vector<CgroupRow> &groups, const std::vector<uint32_t> &rows,
+                  size_t first, size_t last, int y, int y_end) {
+    // same layout as "%-6u %-20s %8.2f %8.2f %9.0f %9.0f"
+    static const int col_x[6] = {0, 7, 28, 37, 46, 56};
+    static const int col_w[6] = {7, 21, 9, 9, 10, -1};
+    char cell[64];
+    for (size_t r = first; r < last; ++r, ++y) {
+        const CgroupRow &g = groups[rows[r]];
+        // keep the tail of long paths, where the container id is
+        std::string name = g.path;
+        if (name.size() > 20) name = "..." + name.substr(name.size() - 17);
+
+        snprintf(cell, sizeof(cell), "%-6u", g.nprocs);
+        frame.put(y, col_x[0], 0, col_w[0], cell);
+        frame.put(y, col_x[1], 1, col_w[1], name.c_str());
+        snprintf(cell, sizeof(cell), "%8.2f", g.cpu_pct);
+        frame.put(y, col_x[2], 2, col_w[2], cell);
+        snprintf(cell, sizeof(cell), "%8.2f", g.mem_pct);
+        frame.put(y, col_x[3], 3, col_w[3], cell);
+        snprintf(cell, sizeof(cell), "%9.0f", g.read_bps / 1024.0);
+        frame.put(y, col_x[4], 4, col_w[4], cell);
+        snprintf(cell, sizeof(cell), "%9.0f", g.write_bps / 1024.0);
+        frame.put(y, col_x[5], 5, col_w[5], cell);
+    }
+    for (; y < y_end; ++y) {
+        for (size_t c = 0; c < 6; ++c) frame.put(y, col_x[c], c, col_w[c], "");
     }
-    return true;
 }
 
-Proc read_process_basic(int pid) {
-    Proc p;
-    p.pid = pid;
-
-    // name from /proc/<pid>/comm
-    p.name = read_first_line("/proc/" + std::to_string(pid) + "/comm");
-
-    // stat file for utime(14) stime(15) cutime cstime starttime(22)
-    std::string stat = read_first_line("/proc/" + std::to_string(pid) + "/stat");
-    if (!stat.empty()) {
-        std::istringstream iss(stat);
-        std::string token;
-        // Fields: pid(1) comm(2) state(3) ... utime is 14th, stime 15th
-        // We'll parse tokens up to 22
-        std::vector<std::string> toks;
-        while (iss >> token) toks.push_back(token);
-        if (toks.size() >= 22) {
-            unsigned long long utime = std::stoull(toks[13]);
-            unsigned long long stime = std::stoull(toks[14]);
-            unsigned long long total_time = utime + stime;
-            p.time = total_time;
-        }
-    }
-
-    // rss from statm or status
-    std::string statm = read_first_line("/proc/" + std::to_string(pid) + "/statm");
-    if (!statm.empty()) {
-        std::istringstream iss(statm);
-        long rss = 0;
-        long size = 0;
-        iss >> size >> rss;
-        p.rss_pages = rss; // pages
-    } else {
-        // fallback: parse VmRSS in /proc/<pid>/status
-        std::ifstream st("/proc/" + std::to_string(pid) + "/status");
-        std::string line;
-        while (std::getline(st, line)) {
-            if (line.rfind("VmRSS:", 0) == 0) {
-                std::istringstream iss(line);
-                std::string k;
-                long kb;
-                iss >> k >> kb;
-                p.rss_pages = kb * 1024 / PAGE_SIZE;
-                break;
-            }
-        }
+// Synthetic procfs tree for --bench: <root>/<pid>/{stat,statm,status,comm,io}
+// for npids processes, plus stat, meminfo, uptime and sys/kernel/pid_max.
+// Names include the awkward cases (spaces, parentheses, kworker suffixes).
+bool write_file(const std::string &path, const std::string &data) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+    close(fd);
+    return ok;
+}
+
+bool make_proc_fixture(const std::string &root, int npids, unsigned seed) {
+    static const char *names[] = {"systemd", "kworker/3:1-events", "postgres", "java", "nginx", "sshd",
+                                  "(sd-pam)", "tmux: server", "Web Content", "a) b (c", "containerd-shim",
+                                  "python3", "bash", "rcu_preempt", "ksoftirqd/12", "node"};
+    std::mt19937 rng(seed);
+    char buf[1024];
+    if (mkdir((root + "/sys").c_str(), 0755) != 0 || mkdir((root + "/sys/kernel").c_str(), 0755) != 0) return false;
+    bool ok = write_file(root + "/sys/kernel/pid_max", "4194304\n");
+    ok = ok && write_file(root + "/uptime", "123456.78 987654.32\n");
+    ok = ok && write_file(root + "/meminfo",
+                          "MemTotal:       65536000 kB\nMemFree:        12345678 kB\nMemAvailable:   34567890 kB\n"
+                          "Buffers:          123456 kB\nCached:         20000000 kB\n");
+    std::string stat = "cpu  1000000 2000 300000 9000000 4000 0 5000 100 0 0\n";
+    for (int c = 0; c < 16; ++c) {
+        snprintf(buf, sizeof(buf), "cpu%d 62500 125 18750 562500 250 0 312 6 0 0\n", c);
+        stat += buf;
+    }
+    stat += "intr 0\nctxt 0\nbtime 0\nprocesses 0\nprocs_running 1\nprocs_blocked 0\n";
+    ok = ok && write_file(root + "/stat", stat);
+
+    for (int i = 0; ok && i < npids; ++i) {
+        int pid = 1 + i * 3; // sparse like a long-running host
+        const char *name = names[rng() % (sizeof(names) / sizeof(names[0]))];
+        std::string dir = root + "/" + std::to_string(pid);
+        if (mkdir(dir.c_str(), 0755) != 0) return false;
+        unsigned long utime = rng() % 1000000, stime = rng() % 100000;
+        unsigned long size = 1000 + rng() % 500000, rss = rng() % 100000;
+        snprintf(buf, sizeof(buf),
+                 "%d (%s) S %d %d %d 0 -1 4194560 %u 0 %u 0 %lu %lu 0 0 20 0 %u 0 %u %lu %lu "
+                 "18446744073709551615 94000000000000 94000000100000 140700000000000 0 0 0 0 4096 1088 0 0 0 17 %u 0 0 0 0 0 "
+                 "94000000200000 94000000300000 94000010000000 140700000001000 140700000002000 140700000002000 140700000003000 0\n",
+                 pid, name, std::max(1, pid / 7), pid, pid, (unsigned)(rng() % 100000), (unsigned)(rng() % 100), utime, stime,
+                 1 + (unsigned)(rng() % 64), (unsigned)(rng() % 1000000), size * 4096, rss, (unsigned)(rng() % 16));
+        ok = write_file(dir + "/stat", buf);
+        snprintf(buf, sizeof(buf), "%lu %lu %lu 100 0 %lu 0\n", size, rss, rss / 4, size / 2);
+        ok = ok && write_file(dir + "/statm", buf);
+        snprintf(buf, sizeof(buf), "Name:\t%s\nVmRSS:\t%lu kB\n", name, rss * 4);
+        ok = ok && write_file(dir + "/status", buf);
+        ok = ok && write_file(dir + "/comm", std::string(name) + "\n");
+        snprintf(buf, sizeof(buf),
+                 "rchar: %u\nwchar: %u\nsyscr: %u\nsyscw: %u\nread_bytes: %u\nwrite_bytes: %u\ncancelled_write_bytes: 0\n",
+                 (unsigned)rng(), (unsigned)rng(), (unsigned)(rng() % 100000), (unsigned)(rng() % 100000),
+                 (unsigned)rng(), (unsigned)rng());
+        ok = ok && write_file(dir + "/io", buf);
     }
+    return ok;
+}
 
-    return p;
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
 }
 
-std::vector<Proc> get_all_processes() {
-    std::vector<Proc> procs;
-    DIR *d = opendir("/proc");
-    if (!d) return procs;
-    struct dirent *entry;
-    while ((entry = readdir(d)) != nullptr) {
-        if (is_digits(entry->d_name)) {
-            int pid = atoi(entry->d_name);
-            // try reading limited info; many pids might vanish between reads
-            Proc p = read_process_basic(pid);
-            procs.push_back(std::move(p));
-        }
+// Run fn until both min_iters and min_seconds are reached and print the mean
+// time per iteration, in the spirit of google-benchmark's console output.
+template <typename F>
+void run_bench(const char *name, int min_iters, double min_seconds, F fn) {
+    LatencyHistogram h;
+    auto begin = steady_clock::now();
+    int iters = 0;
+    while (iters < min_iters || duration_cast<duration<double>>(steady_clock::now() - begin).count() < min_seconds) {
+        auto t0 = steady_clock::now();
+        fn();
+        h.record((uint64_t)duration_cast<nanoseconds>(steady_clock::now() - t0).count());
+        ++iters;
     }
-    closedir(d);
-    return procs;
+    printf("%-24s %14.0f %14llu %14llu %10d\n", name, (double)h.sum.load() / iters,
+           (unsigned long long)h.percentile(0.5), (unsigned long long)h.percentile(0.99), iters);
+    fflush(stdout);
 }
 
-void draw_bar(int y, int x, int width, double fraction) {
-    int filled = (int)(fraction * width + 0.5);
-    for (int i = 0; i < width; ++i) {
-        mvaddch(y, x + i, i < filled ? ACS_CKBOARD : ' ');
+// --bench: build a synthetic /proc with npids processes in a temporary
+// directory, point proc_root at it and time the hot paths against it.
+int run_bench_suite(int npids) {
+    char tmpl[] = "/tmp/sysmon-bench-XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        std::cerr << "mkdtemp: " << strerror(errno) << "\n";
+        return 1;
+    }
+    std::string root = tmpl;
+    printf("fixture: %d pids in %s\n", npids, root.c_str());
+    int rc = 0;
+    if (!make_proc_fixture(root, npids, 42)) {
+        std::cerr << "failed to build fixture in " << root << "\n";
+        rc = 1;
+    } else {
+        proc_root = root;
+        printf("%-24s %14s %14s %14s %10s\n", "benchmark", "mean ns", "p50 ns", "p99 ns", "iters");
+
+        // parse: one stat line, from memory
+        char line[1024];
+        ssize_t len = read_small_file((root + "/1/stat").c_str(), line, sizeof(line));
+        StatRecord sr;
+        run_bench("parse/stat_line", 1000, 0.5, [&] { parse_stat_line(line, (size_t)len, sr); });
+
+        // scan: cold opens every file, warm re-reads cached descriptors,
+        // adaptive is the steady state with every fixture process idle
+        ProcTable procs;
+        bool adaptive = adaptive_sampling;
+        adaptive_sampling = false;
+        run_bench("scan/cold", 3, 1.0, [&] {
+            pid_handles.begin_scan(); // evict everything
+            pid_handles.end_scan();
+            get_all_processes(procs, ProcViews{});
+        });
+        run_bench("scan/warm", 3, 1.0, [&] { get_all_processes(procs, ProcViews{}); });
+        adaptive_sampling = true;
+        for (int i = 0; i < 16; ++i) get_all_processes(procs, ProcViews{}); // settle at the top idle level
+        run_bench("scan/adaptive", 3, 1.0, [&] { get_all_processes(procs, ProcViews{}); });
+        adaptive_sampling = adaptive;
+
+        // delta: the per-tick percentage loop over the table
+        PrevTimeTable prev(read_pid_max());
+        double now = 0.0;
+        run_bench("delta", 10, 0.5, [&] { compute_deltas(procs, prev, now += 1.0, 64000.0); });
+
+        // sort: top of a screen versus the whole table, on spread-out keys
+        std::mt19937 rng(7);
+        for (size_t i = 0; i < procs.size(); ++i) procs.cpu_pct[i] = (double)(rng() % 10000) / 100.0;
+        std::vector<uint32_t> order;
+        run_bench("sort/top50", 10, 0.5, [&] { sort_order(procs, 0, std::min<size_t>(50, procs.size()), order); });
+        run_bench("sort/full", 10, 0.5, [&] { sort_order(procs, 0, procs.size(), order); });
+
+        // frame build: a 50-row table into an off-screen terminal
+        FILE *devnull = fopen("/dev/null", "w+");
+        SCREEN *scr = devnull ? newterm("xterm", devnull, devnull) : nullptr;
+        if (scr) {
+            Frame frame;
+            ProcTable no_threads;
+            size_t shown = std::min<size_t>(50, procs.size());
+            run_bench("frame/full", 100, 0.5, [&] {
+                frame.reset(60, 120);
+                draw_table(frame, procs, no_threads, nullptr, XC_IO, true, order, 0, shown, 1, 55);
+            });
+            run_bench("frame/unchanged", 100, 0.5,
+                      [&] { draw_table(frame, procs, no_threads, nullptr, XC_IO, true, order, 0, shown, 1, 55); });
+            endwin();
+            delscreen(scr);
+        } else {
+            printf("frame/*: skipped (no terminal description for xterm)\n");
+        }
+        if (devnull) fclose(devnull);
+
+        pid_handles.begin_scan(); // close fixture descriptors before removal
+        pid_handles.end_scan();
     }
+    nftw(root.c_str(), remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    return rc;
 }
 
 // Main program
-int main() {
-    // Init ncurses
+int main(int argc, char **argv) {
+    // command line
+    BatchOptions batch;
+    int interval_ms = 1000;
+    bool batch_mode = false;
+    int bench_pids = 0;
+    bool use_proc_events = false;
+    bool use_taskstats = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+            scan_threads = (unsigned)std::max(0, atoi(argv[++i]));
+        } else if (arg == "-b" || arg == "--batch") {
+            batch_mode = true;
+        } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            batch.output = argv[++i];
+        } else if ((arg == "-i" || arg == "--interval") && i + 1 < argc) {
+            interval_ms = std::max(50, atoi(argv[++i]));
+        } else if ((arg == "-n" || arg == "--count") && i + 1 < argc) {
+            batch.count = std::max(0L, atol(argv[++i]));
+        } else if (arg == "--taskstats") {
+            use_taskstats = true;
+        } else if (arg == "--full-scan") {
+            adaptive_sampling = false;
+        } else if (arg == "--proc-events") {
+            use_proc_events = true;
+        } else if (arg == "--proc-root" && i + 1 < argc) {
+            proc_root = argv[++i];
+        } else if (arg == "--cgroup-root" && i + 1 < argc) {
+            cgroup_root = argv[++i];
+        } else if (arg == "--smaps-interval" && i + 1 < argc) {
+            smaps_interval = std::max(0, atoi(argv[++i])) / 1000.0;
+        } else if (arg == "--bench" && i + 1 < argc) {
+            bench_pids = std::max(1, atoi(argv[++i]));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [-t threads] [-i interval_ms] [--full-scan] [--proc-events] [--taskstats] [--proc-root dir] [--cgroup-root dir] [--smaps-interval ms] [-b [-o file] [-n count]]\n"
+                      << "       " << argv[0] << " [-t threads] --bench npids\n";
+            return 1;
+        }
+    }
+
+    if (bench_pids > 0) return run_bench_suite(bench_pids);
+
+    // event-driven PID discovery only makes sense against the live /proc
+    if (use_proc_events && proc_root == "/proc" && !proc_events.open_socket()) {
+        std::cerr << "proc events unavailable (" << strerror(errno) << "), scanning /proc every tick\n";
+    }
+    if (use_taskstats && proc_root == "/proc" && !taskstats.open_socket()) {
+        std::cerr << "taskstats unavailable (" << strerror(errno) << "), parsing /proc/<pid>/stat\n";
+    }
+
+    // headless: no ncurses at all on this path
+    batch.interval_ms = interval_ms;
+    if (batch_mode) return run_batch(batch);
+
+    // Init ncurses. getch() never blocks; the loop poll()s on stdin and the
+    // collector's ready fd instead
     initscr();
     cbreak();
     noecho();
@@ -173,133 +3529,354 @@ int main() {
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
 
-    // bookkeeping
-    std::map<int, unsigned long long> prev_proc_time; // pid -> clock ticks
-    unsigned long long prev_total_time = read_total_time_from_proc_stat();
-    auto last_time = steady_clock::now();
+    // bookkeeping; sampling runs on the collector thread from here on
+    Collector collector{milliseconds(interval_ms)};
+    SnapshotBuffer &snapshots = collector.buffer;
+    std::vector<uint32_t> order;        // display order, indexes the current snapshot
+    std::vector<uint32_t> thread_order; // same for the thread table
+    std::vector<uint32_t> display;      // process rows with the expanded threads spliced in
+    std::vector<int> visible;           // PIDs of the rows on screen
+    std::vector<uint32_t> panel_order;  // disks or interfaces shown in the device panels
+    std::pair<int, int> panel_layout;   // first interface line and table line of the last frame
 
-    // sorting mode: 0 = CPU desc, 1 = MEM desc, 2 = PID asc
+    // sorting mode: 0 = CPU desc, 1 = MEM desc, 2 = PID asc, 3 = disk read desc,
+    // 4 = disk write desc, 5 = cgroups by CPU desc
+    static const char *sort_labels[] = {"CPU %", "MEM %", "PID", "disk read", "disk write"};
     int sort_mode = 0;
+    int scroll = 0; // index of the first table row shown
+    int cursor = 0; // selected table row
+    bool tree_mode = false;                  // 'f': process tree instead of the sorted list
+    int columns = XC_IO;                     // 'n' sockets, 'm' memory detail instead of disk I/O
+    const TreeLayout *shown_tree = nullptr; // tree of the current frame, if drawn as one
+    Frame frame;    // what is currently on screen
+    bool show_phase_stats = false; // 'p' overlay with per-phase timings
+    bool have_snapshot = false;
+    bool redraw = false;
+    bool idle = false; // last getch() found no pending input
+    int max_rows = 1;
 
     while (true) {
-        // handle resize
-        getmaxyx(stdscr, rows, cols);
+        // redraw on a new snapshot, a resize or after a key press
+        if (snapshots.acquire()) have_snapshot = redraw = true;
+        int new_rows, new_cols;
+        getmaxyx(stdscr, new_rows, new_cols);
+        if (new_rows != rows || new_cols != cols) redraw = true;
+        rows = new_rows;
+        cols = new_cols;
 
-        // sample times
-        auto now = steady_clock::now();
-        double interval = duration_cast<duration<double>>(now - last_time).count();
-        if (interval <= 0.0) interval = 1.0; // fallback
-        last_time = now;
+        if (have_snapshot && redraw) {
+            redraw = false;
+            const Snapshot &snap = snapshots.read_slot();
+            const ProcTable &procs = snap.procs;
+            const size_t nprocs = procs.size();
+            // the expanded process's threads, once the collector has caught up
+            const int expanded = expanded_pid.load(std::memory_order_relaxed);
+            const ProcTable &threads = snap.threads;
+            // the grouped view lists cgroups instead of processes
+            const bool grouped = sort_mode == 5;
+            bool show_threads = !grouped && expanded > 0 && snap.threads_pid == expanded &&
+                                std::find(procs.pid.begin(), procs.pid.end(), expanded) != procs.pid.end();
+            const size_t nthreads = show_threads ? threads.size() : 0;
+            // tree view once the collector has flattened a tree for it
+            shown_tree = (!grouped && tree_mode && !snap.tree.rows.empty()) ? &snap.tree : nullptr;
+            // socket or memory detail columns once the collector has filled
+            // them; until then a reused snapshot holds an older sample's rows
+            const bool columns_filled = columns == XC_SOCKETS  ? snap.views.sockets
+                                        : columns == XC_MEMORY ? snap.views.smaps
+                                                               : true;
+            // the MEM sort goes by PSS while the memory detail is shown
+            const bool pss_sort = sort_mode == 1 && columns == XC_MEMORY && snap.views.smaps;
+            const size_t nbase = grouped ? snap.cgroups.size() : shown_tree ? shown_tree->rows.size() : nprocs;
+            const size_t nrows = nbase + nthreads;
+            const double uptime = snap.uptime;
+            const double mem_total_mb = snap.mem_total_mb;
+            const double mem_avail_mb = snap.mem_avail_mb;
 
-        unsigned long long total_time = read_total_time_from_proc_stat();
-        unsigned long long total_time_delta = (total_time > prev_total_time) ? (total_time - prev_total_time) : 0ULL;
-        prev_total_time = total_time;
+            // layout: header and bars above the table, two command lines below
+            const int bar_y = 3;
+            // per-core bars below the memory bar and its legend, as many per line as fit
+            const int core_w = 20; // "NNN [bar     ] xxx%"
+            const int cores_per_line = std::max(1, cols / core_w);
+            const int core_lines = std::min((snap.ncpus + cores_per_line - 1) / cores_per_line, std::max(1, rows / 4));
+            // one line per disk, then per interface, below the cores; the
+            // busiest if not all fit
+            const int disk_y = bar_y + 3 + core_lines;
+            const int disk_lines = std::min((int)snap.disks.size(), std::max(1, rows / 8));
+            const int net_y = disk_y + disk_lines;
+            const int net_lines = std::min((int)snap.nets.size(), std::max(1, rows / 10));
+            const int table_y = net_y + net_lines + 2;
+            const int overlay_lines = show_phase_stats ? PH_COUNT + 1 : 0;
+            max_rows = rows - table_y - 2 - overlay_lines;
+            if (max_rows < 1) max_rows = 1;
+            // keep the cursor on a row and the window around it
+            cursor = std::max(0, std::min(cursor, (int)nrows - 1));
+            scroll = std::min(scroll, cursor);
+            scroll = std::max(scroll, cursor - max_rows + 1);
+            scroll = std::max(0, std::min(scroll, (int)nrows - max_rows));
+            const size_t window_end = std::min(nrows, (size_t)(scroll + max_rows));
 
-        double uptime = get_uptime_seconds();
+            // order only the rows that can be on screen by the active key
+            // column (the tree comes in pre-order); threads by CPU (or TID
+            // in PID mode), spliced in below their process
+            auto phase_start = steady_clock::now();
+            const size_t top_k = std::min(nbase, window_end);
+            if (grouped) {
+                order.resize(nbase);
+                for (size_t i = 0; i < nbase; ++i) order[i] = (uint32_t)i;
+                const std::vector<CgroupRow> &cg = snap.cgroups;
+                select_top(order, top_k, [&cg](uint32_t a, uint32_t b) {
+                    if (cg[a].cpu_pct == cg[b].cpu_pct) return cg[a].path < cg[b].path;
+                    return cg[a].cpu_pct > cg[b].cpu_pct;
+                });
+            } else if (!shown_tree) {
+                sort_order(procs, pss_sort ? 6 : sort_mode, top_k, order);
+            }
+            auto table_row = [&](uint32_t e) { return shown_tree ? shown_tree->rows[e] : e; };
+            display.clear();
+            for (size_t r = 0; r < top_k && display.size() < window_end; ++r) {
+                uint32_t e = shown_tree ? (uint32_t)r : order[r];
+                display.push_back(e);
+                if (!show_threads || procs.pid[table_row(e)] != expanded) continue;
+                size_t k = std::min(nthreads, window_end - display.size());
+                sort_order(threads, sort_mode == 2 ? 2 : 0, k, thread_order);
+                for (size_t j = 0; j < k; ++j) display.push_back(thread_order[j] | THREAD_ROW);
+            }
+            // rows on screen are re-read every tick
+            visible.clear();
+            for (size_t r = (size_t)scroll; r < display.size() && !grouped; ++r) {
+                if (display[r] & THREAD_ROW) visible.push_back(threads.pid[display[r] & ~THREAD_ROW]);
+                else visible.push_back(procs.pid[table_row(display[r])]);
+            }
+            visible_pids.set(visible);
+            size_t fresh = 0;
+            for (size_t i = 0; i < nprocs; ++i) fresh += !procs.stale[i];
 
-        double mem_total_mb, mem_free_mb, mem_avail_mb;
-        read_mem_info(mem_total_mb, mem_free_mb, mem_avail_mb);
+            phase_start = record_phase(PH_SORT, phase_start);
 
-        // Read processes
-        std::vector<Proc> procs = get_all_processes();
+            // UI: draw into the frame, only touching cells that changed
+            // a disk or interface coming or going moves the lines below it
+            if (frame.rows != rows || frame.cols != cols || panel_layout != std::make_pair(net_y, table_y)) {
+                frame.reset(rows, cols);
+                clear();
+                panel_layout = {net_y, table_y};
+            }
+            char line[512];
+            // Header
+            frame.put(0, 0, 0, -1, "Simple System Monitor (single-file)  —  q:quit  k:kill  s:sort-mode");
+            snprintf(line, sizeof(line), "Sort: %s  Interval: %.3fs  Skipped: %llu  Read: %zu/%zu",
+                     grouped      ? "cgroup (CPU %)"
+                     : shown_tree ? "tree (subtree totals)"
+                     : pss_sort   ? "PSS"
+                                  : sort_labels[sort_mode],
+                     snap.interval,
+                     (unsigned long long)ticks_skipped.load(std::memory_order_relaxed), fresh, nprocs);
+            frame.put(1, 0, 0, -1, line);
+            // CPU overall from the aggregate line of /proc/stat
+            const CpuUsage &ct = snap.cpu_total;
+            snprintf(line, sizeof(line), "Uptime: %.1fs  CPU: %.1f%%  iowait: %.1f%%  steal: %.1f%%  Avail: %.1fMB",
+                     uptime, ct.busy, ct.iowait, ct.steal, mem_avail_mb);
+            frame.put(2, 0, 0, -1, line);
 
-        // Compute per-process deltas and percentages
-        for (auto &p : procs) {
-            unsigned long long prev = prev_proc_time.count(p.pid) ? prev_proc_time[p.pid] : p.time;
-            unsigned long long delta = (p.time > prev) ? (p.time - prev) : 0ULL;
-            // CPU percent = (proc_time_delta / CLK_TCK) / interval * 100
-            double proc_seconds = (double)delta / (double)CLK_TCK;
-            p.cpu_pct = (interval > 0.0) ? (proc_seconds / interval) * 100.0 : 0.0;
+            // visual bars, redrawn only when the filled length changes
+            int bar_w = std::max(20, cols / 3);
+            frame.put(bar_y, 0, 0, 24, "CPU usage:");
+            double cpu_fraction = std::min(1.0, ct.busy / 100.0);
+            snprintf(line, sizeof(line), "%d/%d", (int)(cpu_fraction * bar_w + 0.5), bar_w);
+            if (frame.update(bar_y, 1, line)) draw_bar(bar_y, 24, bar_w, cpu_fraction);
+            snprintf(line, sizeof(line), "%.1f%%  %d CPUs", ct.busy, snap.ncpus);
+            frame.put(bar_y, 24 + bar_w + 2, 2, -1, line);
 
-            prev_proc_time[p.pid] = p.time;
+            // memory broken down as htop does: used by processes, shared,
+            // buffers, page cache (with reclaimable slab); free stays blank
+            frame.put(bar_y + 1, 0, 0, 24, "Memory usage:");
+            const MemInfo &mi = snap.mem;
+            double used_mem_mb = mem_total_mb - mem_avail_mb;
+            double mem_fraction = mem_total_mb > 0 ? (used_mem_mb / mem_total_mb) : 0.0;
+            double cache_mb = mi.mb(MI_Cached) + mi.mb(MI_SReclaimable) - mi.mb(MI_Shmem);
+            double apps_mb = mem_total_mb - mi.mb(MI_MemFree) - mi.mb(MI_Buffers) - mi.mb(MI_Cached) - mi.mb(MI_SReclaimable);
+            double segs[4] = {apps_mb, mi.mb(MI_Shmem), mi.mb(MI_Buffers), cache_mb};
+            static const chtype seg_glyphs[4] = {'#', '=', '-', '.'};
+            line[0] = '\0';
+            for (double &f : segs) {
+                f = mem_total_mb > 0 ? f / mem_total_mb : 0.0;
+                snprintf(line + strlen(line), sizeof(line) - strlen(line), "%d ", (int)(f * bar_w + 0.5));
+            }
+            if (frame.update(bar_y + 1, 1, line)) draw_stacked_bar(bar_y + 1, 24, bar_w, segs, seg_glyphs, 4);
+            snprintf(line, sizeof(line), "%.1f/%.1fMB (%.1f%%)", used_mem_mb, mem_total_mb, mem_fraction * 100.0);
+            frame.put(bar_y + 1, 24 + bar_w + 2, 2, -1, line);
+            snprintf(line, sizeof(line),
+                     "  #used %.0fM  =shm %.0fM  -buf %.0fM  .cache %.0fM  swap %.0f/%.0fM  dirty %.0fM  slab %.0fM",
+                     apps_mb, mi.mb(MI_Shmem), mi.mb(MI_Buffers), cache_mb, mi.mb(MI_SwapTotal) - mi.mb(MI_SwapFree),
+                     mi.mb(MI_SwapTotal), mi.mb(MI_Dirty) + mi.mb(MI_Writeback), mi.mb(MI_Slab));
+            frame.put(bar_y + 2, 0, 0, -1, line);
 
-            // memory percent
-            double rss_bytes = (double)p.rss_pages * (double)PAGE_SIZE;
-            double rss_mb = rss_bytes / (1024.0 * 1024.0);
-            p.mem_pct = (mem_total_mb > 0.0) ? (rss_mb / mem_total_mb) * 100.0 : 0.0;
-        }
+            // per-core busy bars; cores that do not fit are summarized
+            for (int c = 0; c < core_lines * cores_per_line; ++c) {
+                int y = bar_y + 3 + c / cores_per_line;
+                int x = (c % cores_per_line) * core_w;
+                size_t cell = (size_t)(c % cores_per_line) * 3;
+                bool last_slot = (c == core_lines * cores_per_line - 1) && snap.ncpus > core_lines * cores_per_line;
+                if (c >= snap.ncpus) {
+                    frame.put(y, x, cell, core_w, "");
+                    continue;
+                }
+                if (last_slot) {
+                    snprintf(line, sizeof(line), "+%d more", snap.ncpus - c);
+                    frame.put(y, x, cell, core_w, line);
+                    continue;
+                }
+                const int w = core_w - 11;
+                double busy = snap.cpu_online[c] ? snap.cpu_usage[c].busy : 0.0;
+                snprintf(line, sizeof(line), "%3d", c);
+                frame.put(y, x, cell, 4, line);
+                snprintf(line, sizeof(line), "%d", snap.cpu_online[c] ? (int)(busy / 100.0 * w + 0.5) : -1);
+                if (frame.update(y, cell + 1, line)) draw_bar(y, x + 4, w, std::min(1.0, busy / 100.0));
+                if (snap.cpu_online[c]) snprintf(line, sizeof(line), "%3.0f%%", busy);
+                else snprintf(line, sizeof(line), " off");
+                frame.put(y, x + 4 + w + 1, cell + 2, 6, line);
+            }
 
-        // sort
-        if (sort_mode == 0) {
-            std::sort(procs.begin(), procs.end(), [](const Proc &a, const Proc &b) {
-                if (a.cpu_pct == b.cpu_pct) return a.pid < b.pid;
-                return a.cpu_pct > b.cpu_pct;
-            });
-        } else if (sort_mode == 1) {
-            std::sort(procs.begin(), procs.end(), [](const Proc &a, const Proc &b) {
-                if (a.mem_pct == b.mem_pct) return a.pid < b.pid;
-                return a.mem_pct > b.mem_pct;
-            });
-        } else {
-            std::sort(procs.begin(), procs.end(), [](const Proc &a, const Proc &b) {
-                return a.pid < b.pid;
-            });
+            // block devices: utilization bar, IOPS, throughput, latency, queue
+            const std::vector<DiskUsage> &disks = snap.disks;
+            pick_busiest(panel_order, disks.size(), (size_t)disk_lines, [&disks](uint32_t d) { return disks[d].util_pct; });
+            for (int l = 0; l < disk_lines; ++l) {
+                const DiskUsage &d = disks[panel_order[l]];
+                const int y = disk_y + l;
+                const int w = 10;
+                frame.put(y, 0, 0, 11, d.name);
+                snprintf(line, sizeof(line), "%d", (int)(d.util_pct / 100.0 * w + 0.5));
+                if (frame.update(y, 1, line)) draw_bar(y, 11, w, d.util_pct / 100.0);
+                snprintf(line, sizeof(line), "%3.0f%%  r %5.0f/s %7.1fMB/s  w %5.0f/s %7.1fMB/s  await %6.2fms  queue %5.2f",
+                         d.util_pct, d.read_iops, d.read_bps / (1024.0 * 1024.0), d.write_iops,
+                         d.write_bps / (1024.0 * 1024.0), d.await_ms, d.queue);
+                frame.put(y, 11 + w + 1, 2, -1, line);
+            }
+
+            // network interfaces: rates in each direction, drops and errors
+            const std::vector<NetUsage> &nets = snap.nets;
+            pick_busiest(panel_order, nets.size(), (size_t)net_lines,
+                         [&nets](uint32_t e) { return nets[e].rx_bps + nets[e].tx_bps; });
+            for (int l = 0; l < net_lines; ++l) {
+                const NetUsage &e = nets[panel_order[l]];
+                const int y = net_y + l;
+                frame.put(y, 0, 0, 11, e.name);
+                snprintf(line, sizeof(line),
+                         "rx %9.1fKB/s %7.0fp/s  tx %9.1fKB/s %7.0fp/s  drop %.0f/%.0f/s  err %.0f/%.0f/s",
+                         e.rx_bps / 1024.0, e.rx_pps, e.tx_bps / 1024.0, e.tx_pps, e.rx_drop, e.tx_drop, e.rx_errs,
+                         e.tx_errs);
+                frame.put(y, 11, 1, -1, line);
+            }
+
+            // Table header
+            int row = table_y - 1;
+            if (grouped) {
+                snprintf(line, sizeof(line), "%-6s %-20s %8s %8s %9s %9s", "PROCS", "CGROUP", "CPU %", "MEM %", "READ KB/s",
+                         "WRIT KB/s");
+            } else if (columns == XC_SOCKETS) {
+                snprintf(line, sizeof(line), "%-6s %-20s %8s %8s %9s %9s %7s %7s", "PID", "NAME", "CPU %", "MEM %",
+                         "TCP", "UDP", "RECVQ K", "SENDQ K");
+            } else if (columns == XC_MEMORY) {
+                snprintf(line, sizeof(line), "%-6s %-20s %8s %8s %9s %9s %7s %7s", "PID", "NAME", "CPU %", "MEM %",
+                         "PSS MB", "USS MB", "SHR MB", "SWAP MB");
+            } else {
+                snprintf(line, sizeof(line), "%-6s %-20s %8s %8s %9s %9s %7s %7s", "PID", "NAME", "CPU %", "MEM %",
+                         "READ KB/s", "WRIT KB/s", "RSYS/s", "WSYS/s");
+            }
+            frame.put(row++, 0, 0, -1, line);
+
+            // show the window of processes (or cgroups) that fits on screen,
+            // cursor row in reverse video
+            if (grouped) draw_cgroups(frame, snap.cgroups, display, (size_t)scroll, display.size(), row, rows - 2 - overlay_lines);
+            else draw_table(frame, procs, threads, shown_tree, columns, columns_filled, display, (size_t)scroll,
+                            display.size(), row, rows - 2 - overlay_lines);
+            for (int y = row; y < row + max_rows && y < rows - 2 - overlay_lines; ++y) {
+                mvchgat(y, 0, -1, y - row == cursor - scroll ? A_REVERSE : A_NORMAL, 0, nullptr);
+            }
+
+            // self-instrumentation overlay above the command lines
+            for (int k = 0; k < overlay_lines; ++k) {
+                format_phase_line(k - 1, line, sizeof(line));
+                frame.put(rows - 2 - overlay_lines + k, 0, 0, -1, line);
+            }
+
+            frame.put(rows - 2, 0, 0, -1, "Commands: q=quit  s=sort  f=tree  t=threads  n=sockets  m=pss  k=kill  p=perf  arrows=move");
+            frame.put(rows - 1, 0, 0, -1, "Enter command: ");
+
+            // batch the update into one write to the terminal
+            wnoutrefresh(stdscr);
+            doupdate();
+            record_phase(PH_RENDER, phase_start);
         }
 
-        // UI
-        clear();
-        // Header
-        mvprintw(0, 0, "Simple System Monitor (single-file)  —  q:quit  k:kill  s:sort-mode");
-        mvprintw(1, 0, "Sort: %s", (sort_mode == 0 ? "CPU %" : (sort_mode == 1 ? "MEM %" : "PID")));
-        // CPU overall (approx using /proc/stat)
-        double cpu_pct = 0.0;
-        if (total_time_delta > 0) {
-            // busy = total_time_delta - idle_delta? We didn't track idle separately; estimate using previous total only gives proportion of all jiffies.
-            // Simpler approach: show 100 * (busy_jiffies / total_jiffies). We'll re-read /proc/stat to get idle if desired;
-            // For simplicity display "N CPUs" and approximate overall using sum of process cpu over interval (may be < 100 for multi-core).
-            double sum_proc_cpu = 0.0;
-            for (auto &p : procs) sum_proc_cpu += p.cpu_pct;
-            cpu_pct = sum_proc_cpu; // note: sum could be >100 if many processes; it's a rough indicator
-        }
-        mvprintw(2, 0, "Uptime: %.1fs  CPU (sum processes): %.2f%%  Mem: %.1fMB total  Avail: %.1fMB",
-                 uptime, cpu_pct, mem_total_mb, mem_avail_mb);
-
-        // visual bars
-        int bar_y = 3;
-        int bar_w = std::max(20, cols / 3);
-        mvprintw(bar_y, 0, "CPU bar (sum processes):");
-        double cpu_fraction = std::min(1.0, cpu_pct / 100.0);
-        draw_bar(bar_y, 24, bar_w, cpu_fraction);
-
-        mvprintw(bar_y + 1, 0, "Memory usage:");
-        double used_mem_mb = mem_total_mb - mem_avail_mb;
-        double mem_fraction = mem_total_mb > 0 ? (used_mem_mb / mem_total_mb) : 0.0;
-        draw_bar(bar_y + 1, 24, bar_w, mem_fraction);
-        mvprintw(bar_y + 1, 24 + bar_w + 2, "%.1f/%.1fMB (%.1f%%)", used_mem_mb, mem_total_mb, mem_fraction * 100.0);
-
-        // Table header
-        int row = bar_y + 3;
-        mvprintw(row++, 0, "%-6s %-20s %8s %8s", "PID", "NAME", "CPU %", "MEM %");
-
-        // show top N processes that fit on screen
-        int max_rows = rows - row - 2;
-        if (max_rows < 1) max_rows = 1;
-        int shown = 0;
-        for (auto &p : procs) {
-            if (shown >= max_rows) break;
-            // sanitize name length
-            std::string name = p.name.empty() ? "[" + std::to_string(p.pid) + "]" : p.name;
-            if ((int)name.size() > 20) name = name.substr(0, 17) + "...";
-
-            mvprintw(row + shown, 0, "%-6d %-20s %8.2f %8.2f", p.pid, name.c_str(), p.cpu_pct, p.mem_pct);
-            ++shown;
-        }
-
-        mvprintw(rows - 2, 0, "Commands: q=quit  s=toggle sort (CPU/MEM/PID)  k=kill <pid>");
-        mvprintw(rows - 1, 0, "Enter command: ");
-
-        // refresh
-        refresh();
-
-        // input handling (non-blocking)
+        // once ncurses has no buffered keys, sleep until a key arrives or the
+        // collector publishes; SIGWINCH interrupts poll() and shows up as
+        // KEY_RESIZE
+        if (idle) {
+            auto wait_start = steady_clock::now();
+            pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {collector.ready_fd, POLLIN, 0}};
+            if (poll(fds, 2, -1) > 0 && (fds[1].revents & POLLIN)) collector.consume_ready();
+            record_phase(PH_SLEEP, wait_start);
+        }
         int ch = getch();
+        idle = (ch == ERR);
+        if (ch == ERR) continue;
+        redraw = true;
         if (ch == 'q' || ch == 'Q') {
             break;
         } else if (ch == 's' || ch == 'S') {
-            sort_mode = (sort_mode + 1) % 3;
+            sort_mode = (sort_mode + 1) % 6;
+            cgroup_view = sort_mode == 5;
+            // the cgroup table has other columns; repaint every cell
+            frame.reset(rows, cols);
+            erase();
+        } else if (ch == 'f' || ch == 'F') {
+            tree_mode = !tree_mode;
+            tree_view = tree_mode;
+        } else if (ch == 'n' || ch == 'N') {
+            // socket columns instead of disk I/O; the collector only walks
+            // descriptors while they are shown
+            columns = columns == XC_SOCKETS ? XC_IO : XC_SOCKETS;
+            socket_view = columns == XC_SOCKETS;
+            smaps_view = false;
+            frame.reset(rows, cols);
+            erase();
+        } else if (ch == 'm' || ch == 'M') {
+            // PSS/USS columns instead of disk I/O, and the MEM sort by PSS;
+            // smaps_rollup is only read while they are shown
+            columns = columns == XC_MEMORY ? XC_IO : XC_MEMORY;
+            smaps_view = columns == XC_MEMORY;
+            socket_view = false;
+            frame.reset(rows, cols);
+            erase();
+        } else if (ch == 'p' || ch == 'P') {
+            // the overlay shares lines with the table; repaint every cell
+            show_phase_stats = !show_phase_stats;
+            frame.reset(rows, cols);
+            erase();
+        } else if (ch == KEY_UP || ch == KEY_DOWN || ch == KEY_PPAGE || ch == KEY_NPAGE || ch == KEY_HOME) {
+            // clamped against the table size on the next redraw
+            if (ch == KEY_UP) cursor = std::max(0, cursor - 1);
+            else if (ch == KEY_DOWN) ++cursor;
+            else if (ch == KEY_PPAGE) cursor = std::max(0, cursor - max_rows);
+            else if (ch == KEY_NPAGE) cursor += max_rows;
+            else cursor = 0;
+        } else if ((ch == 't' || ch == 'T') && sort_mode != 5) {
+            // expand the process under the cursor into its threads, or
+            // collapse when it (or one of its threads) is already expanded
+            int pid = 0;
+            if (cursor >= scroll && (size_t)cursor < display.size() && !(display[cursor] & THREAD_ROW)) {
+                uint32_t e = display[cursor];
+                pid = snapshots.read_slot().procs.pid[shown_tree ? shown_tree->rows[e] : e];
+            }
+            bool on_thread = (size_t)cursor < display.size() && (display[cursor] & THREAD_ROW);
+            if (on_thread) {
+                while (cursor > 0 && (display[cursor] & THREAD_ROW)) --cursor; // back to the process
+            }
+            expanded_pid = (on_thread || pid == expanded_pid) ? 0 : pid;
         } else if (ch == 'k' || ch == 'K') {
-            // prompt for pid. switch to blocking input
-            nodelay(stdscr, FALSE);
+            // prompt for pid. switch to blocking input; sampling carries on
+            // in the collector thread meanwhile
+            timeout(-1);
             echo();
             curs_set(1);
             mvprintw(rows - 1, 0, "Enter PID to kill: ");
@@ -319,15 +3896,13 @@ int main() {
             noecho();
             curs_set(0);
             nodelay(stdscr, TRUE);
-        } else {
-            // sleep small interval
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            // the prompt overwrote the command line; repaint every cell
+            frame.reset(rows, cols);
+            erase();
         }
-
-        // wait until ~1 second elapsed since last sample
-        std::this_thread::sleep_for(std::chrono::milliseconds(800));
     }
 
     endwin();
+    dump_phase_stats(stderr);
     return 0;
 }
\ No newline at end of file